@@ -0,0 +1,167 @@
+// Benchmarks for the Godot-independent simulation core. Built with `scons bench`.
+//
+// Prints one JSON object per benchmark to stdout and a readable summary to stderr:
+//   ./build/bench/fishbytes_bench > results.json
+// Entity, rendering and I/O paths need the engine; see GameManager::run_benchmarks.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "MargolusSimulator.h"
+#include "MaterialSimulator.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Keep sampling until at least this much time has been measured
+    constexpr double MIN_SECONDS = 0.5;
+    // Ticks run from each fresh grid, so sand and water are measured while still moving
+    constexpr int TICKS_PER_SAMPLE = 20;
+
+    struct BenchMaterials {
+        MaterialTable table;
+        MaterialId sand, water, wood;
+
+        BenchMaterials() {
+            table.add(MaterialInfo::ofType(MaterialInfo::EMPTY));
+            sand = table.add(MaterialInfo::ofType(MaterialInfo::GRAVITY));
+            water = table.add(MaterialInfo::ofType(MaterialInfo::FLUID));
+            wood = table.add(MaterialInfo::ofType(MaterialInfo::STATIC));
+        }
+    };
+
+    struct Mix {
+        const char* name;
+        double sand, water, wood;
+    };
+
+    Grid makeGrid(const BenchMaterials& materials, const Mix& mix, int size, Random& random) {
+        Grid grid({size, size});
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                double roll = random.next() / 4294967296.0;
+                if ((roll -= mix.sand) < 0) {
+                    grid[x, y] = Pixel{materials.sand, random};
+                } else if ((roll -= mix.water) < 0) {
+                    grid[x, y] = Pixel{materials.water, random};
+                } else if ((roll -= mix.wood) < 0) {
+                    grid[x, y] = Pixel{materials.wood, random};
+                }
+            }
+        }
+        return grid;
+    }
+
+    // cells is how many tiles one iteration covers
+    void report(const std::string& name, int size, long long iterations, double seconds, double cells) {
+        double nsPerTick = seconds * 1e9 / iterations;
+        double nsPerCell = nsPerTick / cells;
+        std::printf("{\"benchmark\": \"%s\", \"size\": %d, \"iterations\": %lld, \"ns_per_iteration\": %.1f, \"ns_per_cell\": %.3f}\n",
+                    name.c_str(), size, iterations, nsPerTick, nsPerCell);
+        std::fprintf(stderr, "%-24s %5d  %12.1f ns/tick  %8.3f ns/cell\n", name.c_str(), size, nsPerTick, nsPerCell);
+    }
+
+    using Simulate = std::function<void(Grid&, Random&)>;
+
+    void benchmarkTiles(const std::string& name, const BenchMaterials& materials, const Mix& mix, int size, const Simulate& simulate) {
+        Random random{42};
+        const Grid initial = makeGrid(materials, mix, size, random);
+
+        long long ticks = 0;
+        double seconds = 0.0;
+        while (seconds < MIN_SECONDS) {
+            Grid grid = initial;
+            auto start = Clock::now();
+            for (int i = 0; i < TICKS_PER_SAMPLE; ++i) {
+                simulate(grid, random);
+            }
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            ticks += TICKS_PER_SAMPLE;
+        }
+        report(name, size, ticks, seconds, static_cast<double>(size) * size);
+    }
+
+    // Square window scans like SearchForTileNode and the boid vision loop do (column by column), at
+    // random spots of a large grid
+    void benchmarkWindows(const BenchMaterials& materials, int size, int radius) {
+        Random random{7};
+        const Grid grid = makeGrid(materials, {"mixed", 0.25, 0.35, 0.05}, size, random);
+        constexpr int WINDOWS = 256;
+
+        long long windows = 0;
+        long long found = 0;
+        double seconds = 0.0;
+        while (seconds < MIN_SECONDS) {
+            auto start = Clock::now();
+            for (int i = 0; i < WINDOWS; ++i) {
+                const int cx = random.range(radius, size - 1 - radius);
+                const int cy = random.range(radius, size - 1 - radius);
+                for (int x = cx - radius; x <= cx + radius; ++x) {
+                    for (int y = cy - radius; y <= cy + radius; ++y) {
+                        found += grid[x, y].material == materials.wood;
+                    }
+                }
+            }
+            seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            windows += WINDOWS;
+        }
+        // Every batch of windows should find some wood. Checking also keeps the scans from being optimized away.
+        if (found == 0) {
+            std::fprintf(stderr, "window/%d found no wood\n", radius);
+        }
+        const double side = 2 * radius + 1;
+        report("window/" + std::to_string(radius), size, windows, seconds, side * side);
+    }
+}
+
+int main(int argc, char** argv) {
+    // Optional filter on benchmark names, e.g. `fishbytes_bench water` or `fishbytes_bench margolus`
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    const BenchMaterials materials;
+    const Mix mixes[] = {
+        {"sand", 0.4, 0.0, 0.0},
+        {"water", 0.0, 0.6, 0.0},
+        {"mixed", 0.25, 0.35, 0.05},
+    };
+    const int sizes[] = {64, 128, 256, 512};
+
+    for (const Mix& mix : mixes) {
+        std::string tiles = std::string("tiles/") + mix.name;
+        if (std::strstr(tiles.c_str(), filter)) {
+            for (int size : sizes) {
+                benchmarkTiles(tiles, materials, mix, size, [&](Grid& grid, Random& random) {
+                    MaterialSimulator::process(grid, materials.table, random);
+                });
+            }
+        }
+
+        for (int threads : {1, 2, 4}) {
+            std::string margolus = std::string("margolus/") + mix.name + "/" + std::to_string(threads);
+            if (!std::strstr(margolus.c_str(), filter)) {
+                continue;
+            }
+            // One simulator per run, as GameState keeps one, so its workers are only started once
+            MargolusSimulator simulator;
+            for (int size : sizes) {
+                benchmarkTiles(margolus, materials, mix, size, [&](Grid& grid, Random&) {
+                    simulator.process(grid, materials.table, threads);
+                });
+            }
+        }
+    }
+
+    for (int radius : {4, 16, 32}) {
+        if (!std::strstr(("window/" + std::to_string(radius)).c_str(), filter)) {
+            continue;
+        }
+        for (int size : {512, 2048, 4096}) {
+            benchmarkWindows(materials, size, radius);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#include "Autosave.h"
+
+#include "Tracing.h"
+
+bool Autosave::hasData() const {
+    return FileAccess::file_exists(snapshotFile())
+        || FileAccess::file_exists(oldLogFile())
+        || FileAccess::file_exists(logFile());
+}
+
+void Autosave::waitForCompaction() {
+    if (compaction.valid() && !compaction.get()) {
+        UtilityFunctions::printerr("Failed to compact autosave: ", snapshotFile());
+    }
+}
+
+bool Autosave::openLog() {
+    log = FileAccess::open(logFile(), FileAccess::WRITE);
+    if (log.is_null()) {
+        UtilityFunctions::printerr("Failed to open autosave log: ", logFile());
+        return false;
+    }
+    log->store_32(MAGIC);
+    log->store_32(VERSION);
+    log->flush();
+
+    // Make sure the new log is self-contained
+    lastSize = {-1, -1};
+    lastConfig = "";
+    return true;
+}
+
+void Autosave::start(GameState& state) {
+    waitForCompaction();
+    log.unref();
+
+    DirAccess::remove_absolute(snapshotFile());
+    DirAccess::remove_absolute(oldLogFile());
+    if (!openLog()) {
+        return;
+    }
+
+    state.getGrid().markAllDirty();
+    checkpoint(state);
+}
+
+void Autosave::checkpoint(GameState& state) {
+    TRACE_ZONE("Autosave::checkpoint");
+    if (log.is_null()) {
+        return;
+    }
+
+    // Encode dirty chunks first so the palette only holds materials that are actually used
+    Grid& grid = state.getGrid();
+    Materials& materials = state.getMaterials();
+    Ref<StreamPeerBuffer> chunks = memnew(StreamPeerBuffer);
+    std::vector<int> palette(materials.size(), -1);
+    Array paletteNames;
+    for (int cy = 0; cy < grid.chunkCount.y; ++cy) {
+        for (int cx = 0; cx < grid.chunkCount.x; ++cx) {
+            if (!grid.isChunkDirty(cx, cy)) {
+                continue;
+            }
+
+            chunks->put_u8(CHUNK);
+            chunks->put_u16(cx);
+            chunks->put_u16(cy);
+            for (int y = cy * Grid::CHUNK_SIZE; y < Math::min((cy + 1) * Grid::CHUNK_SIZE, grid.size.y); ++y) {
+                for (int x = cx * Grid::CHUNK_SIZE; x < Math::min((cx + 1) * Grid::CHUNK_SIZE, grid.size.x); ++x) {
+                    const Pixel& p = grid.get(x, y);
+                    if (palette[p.material] == -1) {
+                        palette[p.material] = paletteNames.size();
+                        paletteNames.append(materials.getName(p.material));
+                    }
+                    chunks->put_u16(palette[p.material]);
+                    chunks->put_8(p.colorOffset);
+                }
+            }
+        }
+    }
+    grid.clearDirtyChunks();
+
+    bool layoutChanged = grid.size != lastSize || state.getConfigFile() != lastConfig;
+    bool entitiesChanged = state.consumeEntitiesChanged();
+    if (!layoutChanged && !entitiesChanged && chunks->get_size() == 0) {
+        return;
+    }
+
+    Ref<StreamPeerBuffer> payload = memnew(StreamPeerBuffer);
+    if (layoutChanged) {
+        payload->put_u8(LAYOUT);
+        payload->put_u32(grid.size.x);
+        payload->put_u32(grid.size.y);
+        payload->put_utf8_string(state.getConfigFile());
+        lastSize = grid.size;
+        lastConfig = state.getConfigFile();
+    }
+
+    if (!paletteNames.is_empty()) {
+        payload->put_u8(PALETTE);
+        payload->put_u16(paletteNames.size());
+        for (int i = 0; i < paletteNames.size(); ++i) {
+            payload->put_utf8_string(paletteNames[i]);
+        }
+        payload->put_data(chunks->get_data_array());
+    }
+
+    if (entitiesChanged) {
+        const auto& entities = state.getEntityInstances();
+        payload->put_u8(ENTITIES);
+        payload->put_u32(entities.size());
+        for (const Entity* e : entities) {
+            payload->put_var(GameState::saveEntity(*e));
+        }
+    }
+
+    PackedByteArray bytes = payload->get_data_array();
+    log->store_32(bytes.size());
+    log->store_buffer(bytes);
+    log->flush();
+
+    if (log->get_length() > COMPACT_THRESHOLD) {
+        compact(state);
+    }
+}
+
+void Autosave::compact(GameState& state) {
+    // Still folding the previous log; try again at the next checkpoint
+    if (compaction.valid() && compaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    waitForCompaction();
+
+    // A previous compaction failed, so the old log is still needed for recovery
+    if (FileAccess::file_exists(oldLogFile())) {
+        return;
+    }
+
+    // Everything up to now is in the log, so the snapshot taken here supersedes all of it
+    std::unique_ptr<GameState> snapshot = state.clone();
+    log->close();
+    if (DirAccess::rename_absolute(logFile(), oldLogFile()) != OK) {
+        UtilityFunctions::printerr("Failed to rotate autosave log: ", logFile());
+        log = FileAccess::open(logFile(), FileAccess::READ_WRITE);
+        if (log.is_valid()) {
+            log->seek_end();
+        }
+        return;
+    }
+    openLog();
+
+    compaction = std::async(std::launch::async, [snapshot = std::move(snapshot), target = snapshotFile(), oldLog = oldLogFile()] {
+        String tmpFile = target + ".tmp";
+        Ref<FileAccess> file = FileAccess::open(tmpFile, FileAccess::WRITE);
+        if (file.is_null()) {
+            return false;
+        }
+        file->store_var(snapshot->saveSnapshot());
+        file->close();
+
+        if (DirAccess::rename_absolute(tmpFile, target) != OK) {
+            return false;
+        }
+        DirAccess::remove_absolute(oldLog);
+        return true;
+    });
+}
+
+bool Autosave::recover(GameState& state) {
+    TRACE_ZONE("Autosave::recover");
+    waitForCompaction();
+
+    bool recovered = false;
+    if (FileAccess::file_exists(snapshotFile())) {
+        Ref<FileAccess> file = FileAccess::open(snapshotFile(), FileAccess::READ);
+        Variant snapshot = file.is_valid() ? file->get_var() : Variant();
+        if (snapshot.get_type() == Variant::DICTIONARY) {
+            state.loadSnapshot(snapshot);
+            recovered = true;
+        } else {
+            UtilityFunctions::printerr("Failed to read autosave snapshot: ", snapshotFile());
+        }
+    }
+
+    recovered = replayLog(oldLogFile(), state) || recovered;
+    recovered = replayLog(logFile(), state) || recovered;
+    return recovered;
+}
+
+bool Autosave::replayLog(const String& file, GameState& state) {
+    if (!FileAccess::file_exists(file)) {
+        return false;
+    }
+
+    Ref<StreamPeerBuffer> in = memnew(StreamPeerBuffer);
+    in->set_data_array(FileAccess::get_file_as_bytes(file));
+    if (in->get_available_bytes() < 8 || in->get_u32() != MAGIC || in->get_u32() != VERSION) {
+        UtilityFunctions::printerr("Invalid autosave log: ", file);
+        return false;
+    }
+
+    bool applied = false;
+    while (in->get_available_bytes() >= 4) {
+        int64_t length = in->get_u32();
+        if (in->get_available_bytes() < length) {
+            // The last checkpoint was cut short by a crash
+            break;
+        }
+        int64_t end = in->get_position() + length;
+
+        std::vector<MaterialId> palette;
+        while (in->get_position() < end) {
+            switch (in->get_u8()) {
+                case LAYOUT: {
+                    Vector2i size;
+                    size.x = in->get_u32();
+                    size.y = in->get_u32();
+                    String config = in->get_utf8_string();
+                    if (config != state.getConfigFile()) {
+                        state.loadConfig(config);
+                    }
+                    if (size != state.getDimensions()) {
+                        state.clearGrid(size);
+                    }
+                    break;
+                }
+                case PALETTE: {
+                    int count = in->get_u16();
+                    palette.clear();
+                    for (int i = 0; i < count; ++i) {
+                        palette.push_back(state.getMaterials().getId(in->get_utf8_string()));
+                    }
+                    break;
+                }
+                case CHUNK: {
+                    Grid& grid = state.getGrid();
+                    int cx = in->get_u16();
+                    int cy = in->get_u16();
+                    for (int y = cy * Grid::CHUNK_SIZE; y < Math::min((cy + 1) * Grid::CHUNK_SIZE, grid.size.y); ++y) {
+                        for (int x = cx * Grid::CHUNK_SIZE; x < Math::min((cx + 1) * Grid::CHUNK_SIZE, grid.size.x); ++x) {
+                            int index = in->get_u16();
+                            if (index >= palette.size()) {
+                                UtilityFunctions::printerr("Corrupt autosave log: ", file);
+                                return applied;
+                            }
+                            Pixel p;
+                            p.material = palette[index];
+                            p.colorOffset = static_cast<char>(in->get_8());
+                            grid.set(x, y, p);
+                        }
+                    }
+                    break;
+                }
+                case ENTITIES: {
+                    state.clearEntities();
+                    int count = in->get_u32();
+                    for (int i = 0; i < count; ++i) {
+                        Variant data = in->get_var();
+                        if (data.get_type() != Variant::DICTIONARY) {
+                            UtilityFunctions::printerr("Corrupt autosave log: ", file);
+                            return applied;
+                        }
+                        state.restoreEntity(data);
+                    }
+                    break;
+                }
+                default:
+                    UtilityFunctions::printerr("Corrupt autosave log: ", file);
+                    return applied;
+            }
+        }
+        applied = true;
+    }
+    return applied;
+}
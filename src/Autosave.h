@@ -0,0 +1,66 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <future>
+
+#include "godot_includes.h"
+#include "GameState.h"
+
+// Incremental autosave. Every checkpoint appends only the chunks and entity records that
+// changed since the previous one to an append-only log, so its cost follows activity rather
+// than tank size. Once the log grows too large it is compacted in the background into a
+// full snapshot (GameState::saveSnapshot). Both keep tiles' color offsets and entities' exact
+// positions and state, so a recovered tank looks and carries on just like the one saved.
+//
+// Files on disk (relative to basePath):
+//   .snapshot  the last compacted snapshot
+//   .log.old   the log being folded into a new snapshot (only present while compacting)
+//   .log       the current log
+// Recovery loads the snapshot and replays both logs on top of it.
+class Autosave {
+    static constexpr uint32_t MAGIC = 0x4C414246; // "FBAL"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr int64_t COMPACT_THRESHOLD = 8 * 1024 * 1024;
+
+    // Each checkpoint is a length-prefixed sequence of these records, so a checkpoint torn
+    // by a crash is simply dropped on recovery
+    enum RecordType : uint8_t {
+        LAYOUT = 'G',   // grid size and config file
+        PALETTE = 'M',  // material names referenced by the following chunks
+        CHUNK = 'C',    // chunk coordinates followed by a palette index and color offset per tile
+        ENTITIES = 'E', // every entity, as GameState::saveEntity stores it
+    };
+
+    String basePath;
+    Ref<FileAccess> log;
+
+    Vec2i lastSize{-1, -1};
+    String lastConfig;
+
+    std::future<bool> compaction;
+
+    String snapshotFile() const { return basePath + ".snapshot"; }
+    String logFile() const { return basePath + ".log"; }
+    String oldLogFile() const { return basePath + ".log.old"; }
+
+    void waitForCompaction();
+    bool openLog();
+    void compact(GameState& state);
+    static bool replayLog(const String& file, GameState& state);
+
+public:
+    explicit Autosave(String basePath) : basePath(std::move(basePath)) {}
+    ~Autosave() { waitForCompaction(); }
+
+    [[nodiscard]] bool hasData() const;
+
+    // Discards any previous autosave and writes a full checkpoint of the current state
+    void start(GameState& state);
+    // Appends everything that changed since the previous checkpoint
+    void checkpoint(GameState& state);
+    // Restores the state from the files on disk
+    bool recover(GameState& state);
+};
+
+
+#endif //AUTOSAVE_H
@@ -1,5 +1,7 @@
 #include "BehaviorEntity.h"
 
+#include <chrono>
+
 BehaviorEntity::BehaviorEntity(StringName type, Ref<EntityProperties> properties, Vector2 position) : Entity(type, properties, position) {
     auto* props = Object::cast_to<BehaviorProperties>(properties.ptr());
 
@@ -16,6 +18,23 @@ BehaviorEntity::BehaviorEntity(StringName type, Ref<EntityProperties> properties
     }
 }
 
+Entity* BehaviorEntity::clone() const {
+    auto* copy = new BehaviorEntity(*this);
+    // Dictionaries are shared when copied
+    copy->blackboard = blackboard.duplicate(true);
+    return copy;
+}
+
+void BehaviorEntity::saveState(Dictionary& data) const {
+    data["blackboard"] = blackboard.duplicate(true);
+}
+
+void BehaviorEntity::loadState(const Dictionary& data) {
+    if (data.has("blackboard")) {
+        blackboard = Dictionary(data["blackboard"]).duplicate(true);
+    }
+}
+
 void BehaviorEntity::process(double delta, GameState& gameState) {
     auto* props = Object::cast_to<BehaviorProperties>(properties.ptr());
 
@@ -25,13 +44,36 @@ void BehaviorEntity::process(double delta, GameState& gameState) {
     //     done = true;
     // }
 
-    BehaviorNode::Outcome outcome = props->tree->root->process(*this, delta, gameState);
+    BehaviorNode::Outcome outcome = props->tree->root->run(*this, delta, gameState);
     if (outcome != BehaviorNode::RUNNING) {
         dead = true;
     }
 }
 
-void BehaviorNode::print(int indent) {
+BehaviorNode::Outcome BehaviorNode::run(BehaviorEntity& entity, double delta, GameState& gameState) {
+    ++gameState.getCounters().behaviorNodes;
+    if (!gameState.isProfilingBehavior()) {
+        return process(entity, delta, gameState);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Outcome outcome = process(entity, delta, gameState);
+    stats.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    ++stats.invocations;
+    ++stats.outcomes[outcome];
+    return outcome;
+}
+
+void BehaviorNode::resetStats() {
+    stats = Stats();
+    forEachChild([](BehaviorNode& child) { child.resetStats(); });
+}
+
+void BehaviorNode::print(int indent, bool withStats) {
+    printTree(indent, withStats ? &stats : nullptr);
+}
+
+void BehaviorNode::printTree(int indent, const Stats* root) {
     for (int i = 0; i < indent - 1; i++) {
         UtilityFunctions::printraw("|   ");
     }
@@ -39,12 +81,21 @@ void BehaviorNode::print(int indent) {
         UtilityFunctions::printraw("|---");
     }
 
-    UtilityFunctions::printraw(toString(), "\n");
-    printChildren(indent + 1);
+    UtilityFunctions::printraw(toString());
+    if (root) {
+        double ms = stats.nanoseconds / 1e6;
+        UtilityFunctions::printraw(String("  [%d calls, %d/%d/%d S/F/R, %.3f ms, %.2f us/call, %.1f%%]") % Array::make(
+            stats.invocations, stats.outcomes[SUCCESS], stats.outcomes[FAILURE], stats.outcomes[RUNNING], ms,
+            stats.invocations > 0 ? stats.nanoseconds / 1e3 / stats.invocations : 0.0,
+            root->nanoseconds > 0 ? 100.0 * stats.nanoseconds / root->nanoseconds : 0.0));
+    }
+    UtilityFunctions::printraw("\n");
+    forEachChild([&](BehaviorNode& child) { child.printTree(indent + 1, root); });
 }
 
-Ref<BehaviorTree> BehaviorTree::parseBehaviorTree(Dictionary& config) {
+Ref<BehaviorTree> BehaviorTree::parseBehaviorTree(const String& name, Dictionary& config) {
     Ref<BehaviorTree> tree = memnew(BehaviorTree);
+    tree->name = name;
     Dictionary rootData = config.get_or_add("root", Dictionary());
 
     tree->defaultBlackboard = config.get_or_add("blackboard", Dictionary());
@@ -53,6 +104,20 @@ Ref<BehaviorTree> BehaviorTree::parseBehaviorTree(Dictionary& config) {
     return tree;
 }
 
+void BehaviorTree::save(StreamPeerBuffer& out) const {
+    out.put_utf8_string(name);
+    out.put_var(defaultBlackboard);
+    root->save(out);
+}
+
+Ref<BehaviorTree> BehaviorTree::load(StreamPeerBuffer& in) {
+    Ref<BehaviorTree> tree = memnew(BehaviorTree);
+    tree->name = in.get_utf8_string();
+    tree->defaultBlackboard = in.get_var();
+    tree->root = BehaviorNode::load(in);
+    return tree;
+}
+
 std::unique_ptr<BehaviorNode> BehaviorNode::fromDictionary(Dictionary& data) {
     String type = data.get_or_add("type", "");
     if (type == "sequence") {
@@ -83,6 +148,38 @@ std::unique_ptr<BehaviorNode> BehaviorNode::fromDictionary(Dictionary& data) {
     }
 }
 
+std::unique_ptr<BehaviorNode> BehaviorNode::load(StreamPeerBuffer& in) {
+    switch (in.get_u8()) {
+        case NULL_NODE:
+            return std::make_unique<NullNode>();
+        case SEQUENCE:
+            return SequenceNode::load(in);
+        case SELECTOR:
+            return SelectorNode::load(in);
+        case REPEAT_WHILE:
+            return RepeatWhileNode::load(in);
+        case CONSTANT:
+            return ConstantNode::load(in);
+        case INVERT:
+            return InvertNode::load(in);
+        case MOVE:
+            return MoveNode::load(in);
+        case ENFORCE_SWIMMING:
+            return EnforceSwimmingNode::load(in);
+        case SEARCH_FOR_TILE:
+            return SearchForTileNode::load(in);
+        case SEARCH_FOR_ENTITY:
+            return SearchForEntityNode::load(in);
+        case GET_PROPERTY:
+            return GetPropertyNode::load(in);
+        case OPERATION:
+            return OperationNode::load(in);
+        default:
+            UtilityFunctions::printerr("Unknown node kind in config cache");
+            return std::make_unique<NullNode>();
+    }
+}
+
 int SequenceNode::sequenceCounter = 0;
 
 BehaviorNode::Outcome SequenceNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
@@ -91,7 +188,7 @@ BehaviorNode::Outcome SequenceNode::process(BehaviorEntity& entity, double delta
     int currentChild = entity.blackboard.get_or_add(currentChildKey, 0);
     Variant& currentChildVar = entity.blackboard[currentChildKey];
     while (currentChild < children.size()) {
-        Outcome outcome = children[currentChild]->process(entity, delta, gameState);
+        Outcome outcome = children[currentChild]->run(entity, delta, gameState);
         if (outcome == RUNNING) {
             currentChildVar = currentChild;
             return RUNNING;
@@ -115,6 +212,23 @@ std::unique_ptr<SequenceNode> SequenceNode::fromDictionary(Dictionary& data) {
     return node;
 }
 
+void SequenceNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(SEQUENCE);
+    out.put_u32(children.size());
+    for (const auto& child : children) {
+        child->save(out);
+    }
+}
+
+std::unique_ptr<SequenceNode> SequenceNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<SequenceNode> node = std::make_unique<SequenceNode>();
+    uint32_t count = in.get_u32();
+    for (uint32_t i = 0; i < count && in.get_available_bytes() > 0; i++) {
+        node->children.push_back(BehaviorNode::load(in));
+    }
+    return node;
+}
+
 int SelectorNode::selectorCounter = 0;
 
 BehaviorNode::Outcome SelectorNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
@@ -123,7 +237,7 @@ BehaviorNode::Outcome SelectorNode::process(BehaviorEntity& entity, double delta
     int currentChild = entity.blackboard.get_or_add(currentChildKey, 0);
     Variant& currentChildVar = entity.blackboard[currentChildKey];
     while (currentChild < children.size()) {
-        Outcome outcome = children[currentChild]->process(entity, delta, gameState);
+        Outcome outcome = children[currentChild]->run(entity, delta, gameState);
         if (outcome == RUNNING) {
             currentChildVar = currentChild;
             return RUNNING;
@@ -147,9 +261,26 @@ std::unique_ptr<SelectorNode> SelectorNode::fromDictionary(Dictionary& data) {
     return node;
 }
 
+void SelectorNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(SELECTOR);
+    out.put_u32(children.size());
+    for (const auto& child : children) {
+        child->save(out);
+    }
+}
+
+std::unique_ptr<SelectorNode> SelectorNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<SelectorNode> node = std::make_unique<SelectorNode>();
+    uint32_t count = in.get_u32();
+    for (uint32_t i = 0; i < count && in.get_available_bytes() > 0; i++) {
+        node->children.push_back(BehaviorNode::load(in));
+    }
+    return node;
+}
+
 BehaviorNode::Outcome RepeatWhileNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
     for (int i = 0; i < MAX_LOOPS_PER_FRAME; i++) {
-        Outcome outcome = child->process(entity, delta, gameState);
+        Outcome outcome = child->run(entity, delta, gameState);
         if (outcome == RUNNING) {
             return RUNNING;
         } else if (outcome == FAILURE) {
@@ -166,6 +297,17 @@ std::unique_ptr<RepeatWhileNode> RepeatWhileNode::fromDictionary(Dictionary& dat
     return node;
 }
 
+void RepeatWhileNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(REPEAT_WHILE);
+    child->save(out);
+}
+
+std::unique_ptr<RepeatWhileNode> RepeatWhileNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<RepeatWhileNode> node = std::make_unique<RepeatWhileNode>();
+    node->child = BehaviorNode::load(in);
+    return node;
+}
+
 std::unique_ptr<ConstantNode> ConstantNode::fromDictionary(Dictionary& data) {
     std::unique_ptr<ConstantNode> node = std::make_unique<ConstantNode>();
     String outcome = data.get_or_add("outcome", "SUCCESS");
@@ -173,6 +315,17 @@ std::unique_ptr<ConstantNode> ConstantNode::fromDictionary(Dictionary& data) {
     return node;
 }
 
+void ConstantNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(CONSTANT);
+    out.put_u8(outcome);
+}
+
+std::unique_ptr<ConstantNode> ConstantNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<ConstantNode> node = std::make_unique<ConstantNode>();
+    node->outcome = in.get_u8() == FAILURE ? FAILURE : SUCCESS;
+    return node;
+}
+
 std::unique_ptr<InvertNode> InvertNode::fromDictionary(Dictionary& data) {
     std::unique_ptr<InvertNode> node = std::make_unique<InvertNode>();
     Dictionary childData = data.get_or_add("child", Dictionary());
@@ -180,6 +333,17 @@ std::unique_ptr<InvertNode> InvertNode::fromDictionary(Dictionary& data) {
     return node;
 }
 
+void InvertNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(INVERT);
+    child->save(out);
+}
+
+std::unique_ptr<InvertNode> InvertNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<InvertNode> node = std::make_unique<InvertNode>();
+    node->child = BehaviorNode::load(in);
+    return node;
+}
+
 BehaviorNode::Outcome MoveNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
     Vector2 dest = target.get(entity.blackboard);
     Vector2 diff = dest - entity.getPosition();
@@ -205,13 +369,30 @@ std::unique_ptr<MoveNode> MoveNode::fromDictionary(Dictionary& data) {
     return node;
 }
 
+void MoveNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(MOVE);
+    target.save(out);
+    speed.save(out);
+    out.put_u8(isRelative);
+    out.put_u8(failWhenBlocked);
+}
+
+std::unique_ptr<MoveNode> MoveNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<MoveNode> node = std::make_unique<MoveNode>();
+    node->target = BlackboardValue<Vector2>::load(in);
+    node->speed = BlackboardValue<double>::load(in);
+    node->isRelative = in.get_u8();
+    node->failWhenBlocked = in.get_u8();
+    return node;
+}
+
 BehaviorNode::Outcome EnforceSwimmingNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
-    Ref<MaterialProperties> mat = gameState.getMaterialProperties(entity.getCurrentTile(gameState));
+    const Ref<MaterialProperties>& mat = gameState.getMaterialProperties(entity.getCurrentTile(gameState));
     if (mat->isSolid()) {
         entity.die();
         return FAILURE;
     } else if (mat->isFluid()) {
-        return child->process(entity, delta, gameState);
+        return child->run(entity, delta, gameState);
     } else {
         entity.move(Vector2(0, -1) * (real_t) gravity.get(entity.blackboard) * delta, gameState, true);
         return RUNNING;
@@ -230,10 +411,27 @@ std::unique_ptr<EnforceSwimmingNode> EnforceSwimmingNode::fromDictionary(Diction
     return node;
 }
 
+void EnforceSwimmingNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(ENFORCE_SWIMMING);
+    gravity.save(out);
+    child->save(out);
+}
+
+std::unique_ptr<EnforceSwimmingNode> EnforceSwimmingNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<EnforceSwimmingNode> node = std::make_unique<EnforceSwimmingNode>();
+    node->gravity = BlackboardValue<double>::load(in);
+    node->child = BehaviorNode::load(in);
+    return node;
+}
+
 BehaviorNode::Outcome SearchForTileNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
     const Vector2i posI = entity.getPosition().round();
     double radius = this->radius.get(entity.blackboard);
     StringName target = this->target.get(entity.blackboard);
+    int targetId = gameState.getMaterials().findId(target);
+    if (targetId == -1) {
+        return FAILURE;
+    }
 
     Vector2i result;
     double closestSq = -1;
@@ -242,8 +440,7 @@ BehaviorNode::Outcome SearchForTileNode::process(BehaviorEntity& entity, double
         for (int y = -radius; y <= radius; ++y) {
             Vector2i pos = posI + Vector2i(x, y);
             if (!gameState.isInBounds(pos)) { continue; }
-            StringName mat = gameState.getTile(pos).material;
-            if (mat != target) { continue;}
+            if (gameState.getTile(pos).material != targetId) { continue;}
 
             Vector2 diff = pos - entity.getPosition();
             double distSquared = diff.length_squared();
@@ -282,6 +479,23 @@ std::unique_ptr<SearchForTileNode> SearchForTileNode::fromDictionary(Dictionary&
     return node;
 }
 
+void SearchForTileNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(SEARCH_FOR_TILE);
+    target.save(out);
+    radius.save(out);
+    out.put_u8(requireLineOfSight);
+    out.put_utf8_string(resultKey);
+}
+
+std::unique_ptr<SearchForTileNode> SearchForTileNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<SearchForTileNode> node = std::make_unique<SearchForTileNode>();
+    node->target = BlackboardValue<StringName>::load(in);
+    node->radius = BlackboardValue<int>::load(in);
+    node->requireLineOfSight = in.get_u8();
+    node->resultKey = in.get_utf8_string();
+    return node;
+}
+
 BehaviorNode::Outcome SearchForEntityNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
     double radius = this->radius.get(entity.blackboard);
     StringName target = this->target.get(entity.blackboard);
@@ -329,11 +543,28 @@ std::unique_ptr<SearchForEntityNode> SearchForEntityNode::fromDictionary(Diction
     return node;
 }
 
+void SearchForEntityNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(SEARCH_FOR_ENTITY);
+    target.save(out);
+    radius.save(out);
+    out.put_u8(requireLineOfSight);
+    out.put_utf8_string(resultKey);
+}
+
+std::unique_ptr<SearchForEntityNode> SearchForEntityNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<SearchForEntityNode> node = std::make_unique<SearchForEntityNode>();
+    node->target = BlackboardValue<StringName>::load(in);
+    node->radius = BlackboardValue<double>::load(in);
+    node->requireLineOfSight = in.get_u8();
+    node->resultKey = in.get_utf8_string();
+    return node;
+}
+
 BehaviorNode::Outcome GetPropertyNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
     if (property == StringName("position")) {
         entity.blackboard[resultKey] = entity.getPosition();
     } else if (property == StringName("tile")) {
-        entity.blackboard[resultKey] = entity.getCurrentTile(gameState).material;
+        entity.blackboard[resultKey] = gameState.getMaterialName(entity.getCurrentTile(gameState));
     } else if (property == StringName("type")) {
         entity.blackboard[resultKey] = entity.getType();
     } else {
@@ -351,6 +582,19 @@ std::unique_ptr<GetPropertyNode> GetPropertyNode::fromDictionary(Dictionary& dat
     return node;
 }
 
+void GetPropertyNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(GET_PROPERTY);
+    out.put_utf8_string(property);
+    out.put_utf8_string(resultKey);
+}
+
+std::unique_ptr<GetPropertyNode> GetPropertyNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<GetPropertyNode> node = std::make_unique<GetPropertyNode>();
+    node->property = in.get_utf8_string();
+    node->resultKey = in.get_utf8_string();
+    return node;
+}
+
 BehaviorNode::Outcome OperationNode::process(BehaviorEntity& entity, double delta, GameState& gameState) {
     Variant value1 = operand1.get(entity.blackboard);
     Variant value2 = operand2.get(entity.blackboard);
@@ -396,3 +640,20 @@ std::unique_ptr<OperationNode> OperationNode::fromDictionary(Dictionary& data) {
 
     return node;
 }
+
+void OperationNode::save(StreamPeerBuffer& out) const {
+    out.put_u8(OPERATION);
+    out.put_utf8_string(operation);
+    out.put_utf8_string(resultKey);
+    operand1.save(out);
+    operand2.save(out);
+}
+
+std::unique_ptr<OperationNode> OperationNode::load(StreamPeerBuffer& in) {
+    std::unique_ptr<OperationNode> node = std::make_unique<OperationNode>();
+    node->operation = in.get_utf8_string();
+    node->resultKey = in.get_utf8_string();
+    node->operand1 = BlackboardValue<Variant>::load(in);
+    node->operand2 = BlackboardValue<Variant>::load(in);
+    return node;
+}
@@ -9,12 +9,6 @@
 class BehaviorEntity;
 
 class BehaviorNode {
-protected:
-    BehaviorNode() = default;
-
-    virtual String toString() = 0;
-    virtual void printChildren(int indent) {};
-
 public:
     enum Outcome {
         SUCCESS,
@@ -22,19 +16,68 @@ public:
         RUNNING
     };
 
+    // Totals across every entity running this node's tree, collected while profiling
+    struct Stats {
+        int64_t invocations = 0;
+        int64_t outcomes[3] = {};
+        // Includes the time spent in children
+        int64_t nanoseconds = 0;
+    };
+
+protected:
+    BehaviorNode() = default;
+
+    virtual String toString() = 0;
+    virtual void forEachChild(const std::function<void(BehaviorNode&)>& f) {};
+
+private:
+    Stats stats;
+
+    void printTree(int indent, const Stats* root);
+
+public:
     virtual ~BehaviorNode() {}
 
     virtual Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) = 0;
-    void print(int indent = 0);
+    // Runs the node and counts it (and times it when profiling); use this rather than calling process directly
+    Outcome run(BehaviorEntity& entity, double delta, GameState& gameState);
+    // Prints the tree, annotating every node with its profile if withStats is set
+    void print(int indent = 0, bool withStats = false);
+
+    const Stats& getStats() const { return stats; }
+    void resetStats();
 
     static std::unique_ptr<BehaviorNode> fromDictionary(Dictionary& data);
+
+    // Binary form of a parsed tree, for ConfigCache. Each node writes its kind, then its settings.
+    enum Kind : uint8_t {
+        NULL_NODE,
+        SEQUENCE,
+        SELECTOR,
+        REPEAT_WHILE,
+        CONSTANT,
+        INVERT,
+        MOVE,
+        ENFORCE_SWIMMING,
+        SEARCH_FOR_TILE,
+        SEARCH_FOR_ENTITY,
+        GET_PROPERTY,
+        OPERATION,
+    };
+    virtual void save(StreamPeerBuffer& out) const = 0;
+    // Rebuilds a node written by save(); unknown kinds become a NullNode
+    static std::unique_ptr<BehaviorNode> load(StreamPeerBuffer& in);
 };
 
 struct BehaviorTree : public Resource {
+    String name;
     std::unique_ptr<BehaviorNode> root;
     Dictionary defaultBlackboard;
 
-    static Ref<BehaviorTree> parseBehaviorTree(Dictionary& config);
+    static Ref<BehaviorTree> parseBehaviorTree(const String& name, Dictionary& config);
+
+    void save(StreamPeerBuffer& out) const;
+    static Ref<BehaviorTree> load(StreamPeerBuffer& in);
 };
 
 struct BehaviorProperties : EntityProperties {
@@ -50,6 +93,10 @@ public:
 
     BehaviorEntity(StringName type, Ref<EntityProperties> properties, Vector2 position);
 
+    Entity* clone() const override;
+    void saveState(Dictionary& data) const override;
+    void loadState(const Dictionary& data) override;
+
     void process(double delta, GameState& gameState) override;
 };
 
@@ -91,6 +138,22 @@ public:
         return isBlackboard ? "<blackboard: '" + key + "'>" : String("%s") % Array::make(value.value());
     }
 
+    void save(StreamPeerBuffer& out) const {
+        out.put_u8(isBlackboard);
+        if (isBlackboard) {
+            out.put_utf8_string(key);
+        } else {
+            out.put_var(Variant(value.value()));
+        }
+    }
+
+    static BlackboardValue load(StreamPeerBuffer& in) {
+        if (in.get_u8()) {
+            return fromKey(in.get_utf8_string());
+        }
+        return fromValue(in.get_var());
+    }
+
     static BlackboardValue fromDictionary(Dictionary& data, bool isStr = false) {
         if (data.has("key")) {
             return fromKey(data["key"]);
@@ -114,6 +177,10 @@ public:
         UtilityFunctions::printerr("A NullNode is being run");
         return FAILURE;
     }
+
+    void save(StreamPeerBuffer& out) const override {
+        out.put_u8(NULL_NODE);
+    }
 };
 
 class SequenceNode : public BehaviorNode {
@@ -123,9 +190,9 @@ class SequenceNode : public BehaviorNode {
 
     String toString() override { return "SequenceNode"; }
 
-    void printChildren(int indent) override {
+    void forEachChild(const std::function<void(BehaviorNode&)>& f) override {
         for (auto& child : children) {
-            child->print(indent);
+            f(*child);
         }
     }
 
@@ -134,6 +201,8 @@ public:
 
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<SequenceNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<SequenceNode> load(StreamPeerBuffer& in);
 };
 
 class SelectorNode : public BehaviorNode {
@@ -143,9 +212,9 @@ class SelectorNode : public BehaviorNode {
 
     String toString() override { return "SelectorNode"; }
 
-    void printChildren(int indent) override {
+    void forEachChild(const std::function<void(BehaviorNode&)>& f) override {
         for (auto& child : children) {
-            child->print(indent);
+            f(*child);
         }
     }
 
@@ -154,6 +223,8 @@ public:
 
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<SelectorNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<SelectorNode> load(StreamPeerBuffer& in);
 };
 
 class RepeatWhileNode : public BehaviorNode {
@@ -162,11 +233,13 @@ class RepeatWhileNode : public BehaviorNode {
     std::unique_ptr<BehaviorNode> child = nullptr;
 
     String toString() override { return "RepeatWhileNode";}
-    void printChildren(int indent) override { child->print(indent);}
+    void forEachChild(const std::function<void(BehaviorNode&)>& f) override { f(*child); }
 
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<RepeatWhileNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<RepeatWhileNode> load(StreamPeerBuffer& in);
 };
 
 class ConstantNode : public BehaviorNode {
@@ -180,21 +253,25 @@ public:
     }
 
     static std::unique_ptr<ConstantNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<ConstantNode> load(StreamPeerBuffer& in);
 };
 
 class InvertNode : public BehaviorNode {
     std::unique_ptr<BehaviorNode> child = nullptr;
 
     String toString() override { return "InvertNode"; }
-    void printChildren(int indent) override { child->print(indent); }
+    void forEachChild(const std::function<void(BehaviorNode&)>& f) override { f(*child); }
 
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override {
-        Outcome outcome = child->process(entity, delta, gameState);
+        Outcome outcome = child->run(entity, delta, gameState);
         return outcome == RUNNING ? RUNNING : outcome == SUCCESS ? FAILURE : SUCCESS;
     }
 
     static std::unique_ptr<InvertNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<InvertNode> load(StreamPeerBuffer& in);
 };
 
 class MoveNode : public BehaviorNode {
@@ -208,6 +285,8 @@ class MoveNode : public BehaviorNode {
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<MoveNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<MoveNode> load(StreamPeerBuffer& in);
 };
 
 class EnforceSwimmingNode : public BehaviorNode {
@@ -216,11 +295,13 @@ class EnforceSwimmingNode : public BehaviorNode {
     BlackboardValue<double> gravity;
 
     String toString() override { return String("EnforceSwimmingNode(%s)") % Array::make(gravity.toString());}
-    void printChildren(int indent) override { child->print(indent); }
+    void forEachChild(const std::function<void(BehaviorNode&)>& f) override { f(*child); }
 
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<EnforceSwimmingNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<EnforceSwimmingNode> load(StreamPeerBuffer& in);
 };
 
 class SearchForTileNode : public BehaviorNode {
@@ -234,6 +315,8 @@ class SearchForTileNode : public BehaviorNode {
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<SearchForTileNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<SearchForTileNode> load(StreamPeerBuffer& in);
 };
 
 class SearchForEntityNode : public BehaviorNode {
@@ -247,6 +330,8 @@ class SearchForEntityNode : public BehaviorNode {
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<SearchForEntityNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<SearchForEntityNode> load(StreamPeerBuffer& in);
 };
 
 class GetPropertyNode : public BehaviorNode {
@@ -258,6 +343,8 @@ class GetPropertyNode : public BehaviorNode {
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<GetPropertyNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<GetPropertyNode> load(StreamPeerBuffer& in);
 };
 
 class OperationNode : public BehaviorNode {
@@ -271,6 +358,8 @@ class OperationNode : public BehaviorNode {
 public:
     Outcome process(BehaviorEntity& entity, double delta, GameState& gameState) override;
     static std::unique_ptr<OperationNode> fromDictionary(Dictionary& data);
+    void save(StreamPeerBuffer& out) const override;
+    static std::unique_ptr<OperationNode> load(StreamPeerBuffer& in);
 };
 
 #endif //BEHAVIORENTITY_H
@@ -0,0 +1,209 @@
+#include "Benchmarks.h"
+
+#include <chrono>
+
+#include "BehaviorEntity.h"
+#include "GameState.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Keep repeating until at least this much time has been measured
+    constexpr double MIN_SECONDS = 0.5;
+
+    // Runs body until MIN_SECONDS have passed; returns the iteration count and the time taken
+    template <typename F>
+    std::pair<int64_t, double> measure(F&& body) {
+        int64_t iterations = 0;
+        auto start = Clock::now();
+        double seconds = 0.0;
+        while (seconds < MIN_SECONDS) {
+            body();
+            ++iterations;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        return {iterations, seconds};
+    }
+
+    // A constant BlackboardValue, as written in a config
+    Dictionary blackboardValue(const Variant& value) {
+        Dictionary result;
+        result["value"] = value;
+        return result;
+    }
+}
+
+Benchmarks::Benchmarks(String configFile, Materials materials, Entities entities)
+        : configFile(std::move(configFile)), materials(std::move(materials)), entities(std::move(entities)) {
+    Array names = this->materials.getAllMaterials();
+    for (int i = 0; i < names.size(); ++i) {
+        StringName name = names[i];
+        auto props = this->materials.getProperties(name);
+        if (props->isFluid() && fluid.is_empty()) {
+            fluid = name;
+        } else if (props->type == MaterialProperties::GRAVITY && solid.is_empty()) {
+            solid = name;
+        }
+    }
+
+    Array types = this->entities.getAllEntities();
+    for (int i = 0; i < types.size(); ++i) {
+        StringName type = types[i];
+        if (this->entities.getProperties(type)->type == EntityProperties::BOID) {
+            boid = type;
+            break;
+        }
+    }
+}
+
+void Benchmarks::report(const String& name, const String& parameter, int value, int64_t iterations, double seconds, const String& unit, double units) {
+    double nsPerIteration = seconds * 1e9 / iterations;
+
+    Dictionary result;
+    result["benchmark"] = name;
+    result[parameter] = value;
+    result["iterations"] = iterations;
+    result["ns_per_iteration"] = nsPerIteration;
+    result["ns_per_" + unit] = nsPerIteration / units;
+    results.append(result);
+
+    UtilityFunctions::print(String("{0} {1}={2}: {3} ns/iteration, {4} ns/{5}").format(
+        Array::make(name, parameter, value, nsPerIteration, nsPerIteration / units, unit)));
+}
+
+void Benchmarks::benchmarkFrame(int size) {
+    GameState state(nullptr, {size, size}, 0.0, 0.0);
+    state.setConfig(configFile, materials, entities);
+
+    Array names = materials.getAllMaterials();
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            state.paint(names[(x + y * 7) % names.size()], {{x, y}});
+        }
+    }
+
+    Ref<Image> image = Image::create_empty(size, size, false, Image::FORMAT_RGBA8);
+    auto [iterations, seconds] = measure([&] { state.generateFrame(image); });
+    report("generate_frame", "size", size, iterations, seconds, "cell", size * size);
+}
+
+void Benchmarks::benchmarkBoids(int count) {
+    constexpr int size = 128;
+    GameState state(nullptr, {size, size}, 0.0, 1.0);
+    state.setConfig(configFile, materials, entities);
+    state.getGrid().fill(state.makePixel(materials.getId(fluid)));
+
+    Random random{static_cast<uint64_t>(count)};
+    for (int i = 0; i < count; ++i) {
+        state.spawnEntity({random.range(0, size - 1), random.range(0, size - 1)}, boid);
+    }
+
+    // Tiles are standing still, so this only measures the entities
+    TickScheduler scheduler;
+    auto [iterations, seconds] = measure([&] { state.process(1.0 / 60.0, scheduler); });
+    report("boids/" + String(boid), "entities", count, iterations, seconds, "entity", count);
+}
+
+void Benchmarks::benchmarkTileSearch(int radius, bool lineOfSight) {
+    constexpr int size = 128;
+    GameState state(nullptr, {size, size}, 0.0, 0.0);
+    state.setConfig(configFile, materials, entities);
+    state.getGrid().fill(state.makePixel(materials.getId(fluid)));
+
+    // Sparse targets, so most searches scan their whole area
+    Random random{static_cast<uint64_t>(radius)};
+    for (int i = 0; i < size * size / 100; ++i) {
+        state.paint(solid, {{random.range(0, size - 1), random.range(0, size - 1)}});
+    }
+
+    Dictionary config;
+    config["radius"] = blackboardValue(radius);
+    config["target"] = blackboardValue(solid);
+    config["require_line_of_sight"] = lineOfSight;
+    config["result_key"] = "result";
+    std::unique_ptr<SearchForTileNode> node = SearchForTileNode::fromDictionary(config);
+
+    Ref<BehaviorProperties> props = memnew(BehaviorProperties);
+    props->tree = Ref<BehaviorTree>(memnew(BehaviorTree));
+    BehaviorEntity entity("benchmark", props, Vector2(size / 2, size / 2));
+
+    auto [iterations, seconds] = measure([&] { node->run(entity, 1.0 / 60.0, state); });
+    double area = (2 * radius + 1) * (2 * radius + 1);
+    report(lineOfSight ? "search_for_tile/line_of_sight" : "search_for_tile", "radius", radius, iterations, seconds, "cell", area);
+}
+
+void Benchmarks::benchmarkEntitySearch(int count) {
+    constexpr int size = 128;
+    GameState state(nullptr, {size, size}, 0.0, 0.0);
+    state.setConfig(configFile, materials, entities);
+    state.getGrid().fill(state.makePixel(materials.getId(fluid)));
+
+    Random random{static_cast<uint64_t>(count)};
+    for (int i = 0; i < count; ++i) {
+        state.spawnEntity({random.range(0, size - 1), random.range(0, size - 1)}, boid);
+    }
+
+    Dictionary config;
+    config["radius"] = blackboardValue(20);
+    config["target"] = blackboardValue(boid);
+    config["result_key"] = "result";
+    std::unique_ptr<SearchForEntityNode> node = SearchForEntityNode::fromDictionary(config);
+
+    Ref<BehaviorProperties> props = memnew(BehaviorProperties);
+    props->tree = Ref<BehaviorTree>(memnew(BehaviorTree));
+    BehaviorEntity entity("benchmark", props, Vector2(size / 2, size / 2));
+
+    // Every search visits every entity (there is no spatial partition yet)
+    auto [iterations, seconds] = measure([&] { node->run(entity, 1.0 / 60.0, state); });
+    report("search_for_entity", "entities", count, iterations, seconds, "entity", count);
+}
+
+void Benchmarks::benchmarkRoundTrip(int size) {
+    GameState state(nullptr, {size, size}, 0.0, 0.0);
+    state.setConfig(configFile, materials, entities);
+
+    Array names = materials.getAllMaterials();
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            state.paint(names[(x * 3 + y) % names.size()], {{x, y}});
+        }
+    }
+
+    auto [iterations, seconds] = measure([&] {
+        Ref<JSON> json = state.exportData();
+        // The config is already loaded, and without a GameManager it couldn't be reloaded anyway
+        Dictionary(json->get_data()).erase("config");
+        state.importData(json);
+    });
+    report("export_import", "size", size, iterations, seconds, "cell", size * size);
+}
+
+Array Benchmarks::run() {
+    results.clear();
+
+    for (int size : {64, 128, 256, 512}) {
+        benchmarkFrame(size);
+    }
+    for (int size : {64, 128, 256}) {
+        benchmarkRoundTrip(size);
+    }
+
+    if (fluid.is_empty() || solid.is_empty()) {
+        UtilityFunctions::printerr("Config needs a FLUID and a GRAVITY material for the search benchmarks: ", configFile);
+        return results;
+    }
+    for (int radius : {5, 10, 20, 40}) {
+        benchmarkTileSearch(radius, false);
+        benchmarkTileSearch(radius, true);
+    }
+
+    if (boid.is_empty()) {
+        UtilityFunctions::printerr("Config needs a BOID entity for the entity benchmarks: ", configFile);
+        return results;
+    }
+    for (int count : {10, 100, 1000}) {
+        benchmarkBoids(count);
+        benchmarkEntitySearch(count);
+    }
+    return results;
+}
@@ -0,0 +1,38 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include "godot_includes.h"
+#include "Materials.h"
+#include "Entities.h"
+
+// Benchmarks for the hot paths that need the engine: rendering, entities, behavior tree
+// searches and save/load. The tile simulation is benchmarked without Godot by `scons bench`.
+//
+// Each result is a Dictionary with the benchmark name, its parameter, the number of iterations,
+// ns_per_iteration and a normalized ns_per_cell or ns_per_entity.
+class Benchmarks {
+    String configFile;
+    Materials materials;
+    Entities entities;
+
+    // Picked from the config so the benchmarks work with any of them
+    StringName fluid, solid, boid;
+
+    Array results;
+
+    void report(const String& name, const String& parameter, int value, int64_t iterations, double seconds, const String& unit, double units);
+
+    void benchmarkFrame(int size);
+    void benchmarkBoids(int count);
+    void benchmarkTileSearch(int radius, bool lineOfSight);
+    void benchmarkEntitySearch(int count);
+    void benchmarkRoundTrip(int size);
+
+public:
+    Benchmarks(String configFile, Materials materials, Entities entities);
+
+    Array run();
+};
+
+
+#endif //BENCHMARKS_H
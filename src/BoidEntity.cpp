@@ -22,14 +22,60 @@ Ref<BoidProperties::BoidConfig> BoidProperties::BoidConfig::parseBoidConfig(Dict
     return props;
 }
 
-BoidEntity::BoidEntity(StringName type, Ref<EntityProperties> properties, Vector2 position) : Entity(type, properties, position) {
+void BoidProperties::BoidConfig::save(StreamPeerBuffer& out) const {
+    out.put_32(trailLen);
+    out.put_32(visionRadius);
+    for (double value : {groupRadius, maxSpeed, maxAccel, dragPercent, bouncePercent, separationWeight,
+                         alignmentPercent, cohesionWeight, obstacleWeight}) {
+        out.put_double(value);
+    }
+    out.put_var(tileWeights);
+    out.put_var(entityWeights);
+    out.put_var(food);
+    out.put_var(prey);
+}
+
+Ref<BoidProperties::BoidConfig> BoidProperties::BoidConfig::load(StreamPeerBuffer& in) {
+    Ref<BoidConfig> props = memnew(BoidConfig);
+    props->trailLen = in.get_32();
+    props->visionRadius = in.get_32();
+    for (double* value : {&props->groupRadius, &props->maxSpeed, &props->maxAccel, &props->dragPercent, &props->bouncePercent,
+                          &props->separationWeight, &props->alignmentPercent, &props->cohesionWeight, &props->obstacleWeight}) {
+        *value = in.get_double();
+    }
+    props->tileWeights = in.get_var();
+    props->entityWeights = in.get_var();
+    props->food = in.get_var();
+    props->prey = in.get_var();
+    return props;
+}
+
+BoidEntity::BoidEntity(StringName type, Ref<EntityProperties> properties, Vector2 position, Random& random) : Entity(type, properties, position) {
     // TODO: make this more configurable
-    velocity = Vector2::from_angle(UtilityFunctions::randf_range(0, Math_TAU)) * 10;
+    velocity = Vector2::from_angle(random.uniform() * Math_TAU) * 10;
 
     // Make sure the properties is a BoidProperties
     (void) Object::cast_to<BoidProperties>(properties.ptr());
 }
 
+void BoidEntity::saveState(Dictionary& data) const {
+    data["velocity"] = velocity;
+    Array trailData;
+    for (const Vector2i& trailPos : trail) {
+        trailData.append(trailPos);
+    }
+    data["trail"] = trailData;
+}
+
+void BoidEntity::loadState(const Dictionary& data) {
+    velocity = data.get("velocity", velocity);
+    Array trailData = data.get("trail", Array());
+    trail.clear();
+    for (int i = 0; i < trailData.size(); ++i) {
+        trail.push_back(Vector2i(trailData[i]));
+    }
+}
+
 void BoidEntity::process(double delta, GameState& gameState) {
     Ref<BoidProperties::BoidConfig> config = Object::cast_to<BoidProperties>(properties.ptr())->boidConfig;
 
@@ -38,13 +84,13 @@ void BoidEntity::process(double delta, GameState& gameState) {
         return;
     }
 
-    Ref<MaterialProperties> curTile = gameState.getMaterialProperties(getCurrentTile(gameState));
+    const Ref<MaterialProperties>& curTile = gameState.getMaterialProperties(getCurrentTile(gameState));
     if (curTile->type == MaterialProperties::EMPTY) {
         position -= Vector2(0, delta * 10); // TODO: make gravity configurable
         return;
     } else if (curTile->isSolid()) {
         // TODO: don't hard-code this
-        if (config->food.has(getCurrentTile(gameState).material)) {
+        if (config->food.has(gameState.getMaterialName(getCurrentTile(gameState)))) {
             gameState.setTile(position.round(), Pixel{});
         } else {
             dead = true;
@@ -121,8 +167,9 @@ void BoidEntity::process(double delta, GameState& gameState) {
     for (int x = -config->visionRadius; x <= config->visionRadius; ++x) {
         for (int y = -config->visionRadius; y <= config->visionRadius; ++y) {
             Vector2i pos = posI + Vector2i(x, y);
-            StringName mat = gameState.getTile(pos).material;
-            Ref<MaterialProperties> properties = gameState.getMaterialProperties(mat);
+            Pixel tile = gameState.getTile(pos);
+            const StringName& mat = gameState.getMaterialName(tile);
+            const Ref<MaterialProperties>& properties = gameState.getMaterialProperties(tile);
 
             Vector2 diff = pos - position;
             double distSquared = diff.length_squared();
@@ -150,8 +197,8 @@ void BoidEntity::process(double delta, GameState& gameState) {
 
     // Eat food
     Vector2 newPos = position + velocity * delta;
-    if (config->food.has(gameState.getTile(newPos.round()).material)) {
-        gameState.setTile(newPos.round(), Pixel(""));
+    if (config->food.has(gameState.getMaterialName(gameState.getTile(newPos.round())))) {
+        gameState.setTile(newPos.round(), Pixel{});
     }
 
     // Move and rebound
@@ -170,15 +217,15 @@ void BoidEntity::process(double delta, GameState& gameState) {
     }
 }
 
-void BoidEntity::render(Ref<Image> image) {
+void BoidEntity::render(FrameSnapshot& frame) {
     Vector2i pos = position.round();
-    image->set_pixel(pos.x, pos.y, properties->color);
+    frame.sprites.push_back({pos, properties->color});
 
     Color trailColor = properties->color;
     trailColor.a *= 0.5;
     for (Vector2i trailPos : trail) {
         if (trailPos != pos) {
-            image->set_pixel(trailPos.x, trailPos.y, trailColor);
+            frame.sprites.push_back({trailPos, trailColor});
         }
     }
 }
@@ -31,6 +31,10 @@ struct BoidProperties : EntityProperties {
         Array prey;
 
         static Ref<BoidConfig> parseBoidConfig(Dictionary& data);
+
+        // Binary form for ConfigCache
+        void save(StreamPeerBuffer& out) const;
+        static Ref<BoidConfig> load(StreamPeerBuffer& in);
     };
 
     Ref<BoidConfig> boidConfig;
@@ -42,11 +46,15 @@ class BoidEntity : public Entity {
     std::deque<Vector2i> trail{};
 
 public:
-    BoidEntity(StringName type, Ref<EntityProperties> properties, Vector2 position);
+    BoidEntity(StringName type, Ref<EntityProperties> properties, Vector2 position, Random& random);
+
+    Entity* clone() const override { return new BoidEntity(*this); }
+    void saveState(Dictionary& data) const override;
+    void loadState(const Dictionary& data) override;
 
     void process(double delta, GameState& gameState) override;
 
-    void render(Ref<Image> image) override;
+    void render(FrameSnapshot& frame) override;
 };
 
 
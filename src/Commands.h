@@ -0,0 +1,84 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <variant>
+#include <vector>
+
+#include "godot_includes.h"
+
+// Requests from the UI and input to change the simulation. They are queued by the main thread
+// and applied by whichever thread owns the GameState, in order, at tick boundaries.
+
+// One frame's worth of a brush stroke
+struct PaintCommand {
+    StringName material;
+    std::vector<Vector2i> cells;
+    bool beginsStroke = false; // Whether to save an undo state first
+};
+
+struct SpawnCommand {
+    StringName type;
+    Vector2i position;
+};
+
+struct ClearCommand {};
+
+struct LoadConfigCommand {
+    String file;
+    bool undoable = false;
+};
+
+struct ImportDataCommand {
+    Ref<JSON> data;
+};
+
+struct ExportDataCommand {
+    String file;
+};
+
+struct UndoCommand {};
+
+struct SpeedCommand {
+    double tileSpeed = 0.0;
+    double entitySpeed = 1.0;
+};
+
+struct RecoverAutosaveCommand {};
+
+// An empty file stops recording
+struct RecordJournalCommand {
+    String file;
+};
+
+// Prints every behavior tree annotated with its profile, optionally starting a new one
+struct PrintBehaviorProfileCommand {
+    bool reset = false;
+};
+
+// Paths are read by whichever thread owns the GameState, so changes to them are handed over too
+struct AutosavePathCommand {
+    String path;
+};
+
+struct WatchdogPathCommand {
+    String path;
+};
+
+using Command = std::variant<
+    PaintCommand,
+    SpawnCommand,
+    ClearCommand,
+    LoadConfigCommand,
+    ImportDataCommand,
+    ExportDataCommand,
+    UndoCommand,
+    SpeedCommand,
+    RecoverAutosaveCommand,
+    RecordJournalCommand,
+    PrintBehaviorProfileCommand,
+    AutosavePathCommand,
+    WatchdogPathCommand
+>;
+
+
+#endif //COMMANDS_H
@@ -0,0 +1,95 @@
+#include "ConfigCache.h"
+
+#include "Tracing.h"
+
+std::optional<ConfigCache::Entry> ConfigCache::load(const String& file) {
+    TRACE_ZONE("ConfigCache::load");
+    String hash = FileAccess::get_md5(file);
+    if (hash.is_empty()) {
+        return std::nullopt;
+    }
+
+    std::lock_guard lock(mutex);
+    if (const Entry* entry = entries.getptr(hash)) {
+        ++stats.fromMemory;
+        return *entry;
+    }
+
+    std::optional<Entry> entry = readBlob(hash);
+    if (entry) {
+        ++stats.fromBlob;
+    } else {
+        entry = parse(file);
+        if (!entry) {
+            return std::nullopt;
+        }
+        ++stats.parsed;
+        writeBlob(hash, *entry);
+    }
+
+    entries.insert(hash, *entry);
+    return entry;
+}
+
+ConfigCache::Stats ConfigCache::getStats() const {
+    std::lock_guard lock(mutex);
+    return stats;
+}
+
+std::optional<ConfigCache::Entry> ConfigCache::parse(const String& file) {
+    TRACE_ZONE("ConfigCache::parse");
+    Ref<JSON> json = ResourceLoader::get_singleton()->load(file, "JSON");
+    if (json.is_null()) {
+        return std::nullopt;
+    }
+
+    Dictionary config = Dictionary(json->get_data()).duplicate(true);
+    Dictionary materials = config.get_or_add("materials", Dictionary());
+    Dictionary entities = config.get_or_add("entities", Dictionary());
+    Dictionary entityConfig = config.get_or_add("entityConfig", Dictionary());
+    Dictionary simulation = config.get_or_add("simulation", Dictionary());
+    Entry entry{Materials(materials), Entities(entities, entityConfig)};
+    entry.materials.setMode(Materials::modeFromString(simulation.get_or_add("mode", "SEQUENTIAL")));
+    return entry;
+}
+
+std::optional<ConfigCache::Entry> ConfigCache::readBlob(const String& hash) const {
+    String path = blobFile(hash);
+    if (!FileAccess::file_exists(path)) {
+        return std::nullopt;
+    }
+
+    Ref<StreamPeerBuffer> in = memnew(StreamPeerBuffer);
+    in->set_data_array(FileAccess::get_file_as_bytes(path));
+    if (in->get_available_bytes() < 8 || in->get_u32() != MAGIC || in->get_u32() != VERSION
+            || in->get_utf8_string() != hash) {
+        return std::nullopt;
+    }
+
+    // The simulation mode is part of the material table
+    std::optional<Materials> materials = Materials::load(*in.ptr());
+    std::optional<Entities> entities = materials ? Entities::load(*in.ptr()) : std::nullopt;
+    if (!entities) {
+        UtilityFunctions::printerr("Corrupt config cache: ", path);
+        return std::nullopt;
+    }
+    return Entry{std::move(*materials), std::move(*entities)};
+}
+
+void ConfigCache::writeBlob(const String& hash, const Entry& entry) const {
+    DirAccess::make_dir_recursive_absolute(cacheDir);
+
+    Ref<StreamPeerBuffer> out = memnew(StreamPeerBuffer);
+    out->put_u32(MAGIC);
+    out->put_u32(VERSION);
+    out->put_utf8_string(hash);
+    entry.materials.save(*out.ptr());
+    entry.entities.save(*out.ptr());
+
+    Ref<FileAccess> file = FileAccess::open(blobFile(hash), FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("Failed to write config cache: ", blobFile(hash));
+        return;
+    }
+    file->store_buffer(out->get_data_array());
+}
@@ -0,0 +1,58 @@
+#ifndef CONFIGCACHE_H
+#define CONFIGCACHE_H
+
+#include <mutex>
+#include <optional>
+
+#include "godot_includes.h"
+#include "Materials.h"
+#include "Entities.h"
+
+// Binary config cache. Configs are keyed by the MD5 of their source file. Each parsed config is
+// kept in memory for the rest of the session, so switching back to one costs nothing, and the
+// built config (material table with its compiled rules, entity types, boid configs and behavior
+// trees) is written to a binary blob in cacheDir. Later sessions build Materials and Entities
+// straight from that blob in one read, without running the JSON, material, entity or behavior tree
+// parsers. Safe to use from several threads.
+class ConfigCache {
+    static constexpr uint32_t MAGIC = 0x43434246; // "FBCC"
+    // Bump whenever the parsers' defaults or the blob layout change
+    static constexpr uint32_t VERSION = 3;
+
+public:
+    struct Entry {
+        Materials materials;
+        Entities entities;
+    };
+
+    // How each load was served, so a cold start can be checked to skip the parsers
+    struct Stats {
+        int parsed = 0;
+        int fromBlob = 0;
+        int fromMemory = 0;
+    };
+
+private:
+    String cacheDir;
+    HashMap<String, Entry> entries;
+    Stats stats;
+    mutable std::mutex mutex;
+
+    String blobFile(const String& hash) const { return cacheDir.path_join(hash + ".fbc"); }
+
+    std::optional<Entry> readBlob(const String& hash) const;
+    void writeBlob(const String& hash, const Entry& entry) const;
+
+    static std::optional<Entry> parse(const String& file);
+
+public:
+    explicit ConfigCache(String cacheDir = "user://config_cache") : cacheDir(std::move(cacheDir)) {}
+
+    // Returns the parsed config for the given file, or nothing if it couldn't be loaded
+    std::optional<Entry> load(const String& file);
+
+    Stats getStats() const;
+};
+
+
+#endif //CONFIGCACHE_H
@@ -1,5 +1,6 @@
 #include "Entities.h"
 
+#include "Tracing.h"
 #include "BehaviorEntity.h"
 #include "BoidEntity.h"
 
@@ -20,15 +21,15 @@ Dictionary Entities::parseBehaviorTrees(Dictionary behaviorData) {
     for (int i = 0; i < ids.size(); ++i) {
         String id = ids[i];
         Dictionary config = behaviorData[id];
-        behaviorTrees[id] = BehaviorTree::parseBehaviorTree(config);
+        behaviorTrees[id] = BehaviorTree::parseBehaviorTree(id, config);
     }
     return behaviorTrees;
 }
 
 
 Entities::Entities(Dictionary entities, Dictionary entityConfig) {
-    Dictionary boidConfigs = parseBoidConfigs(entityConfig.get_or_add("boids", Dictionary()));
-    Dictionary behaviorTrees = parseBehaviorTrees(entityConfig.get_or_add("behaviorTrees", Dictionary()));
+    boidConfigs = parseBoidConfigs(entityConfig.get_or_add("boids", Dictionary()));
+    behaviorTrees = parseBehaviorTrees(entityConfig.get_or_add("behaviorTrees", Dictionary()));
 
     Array ids = entities.keys();
     for (int i = 0; i < ids.size(); ++i) {
@@ -81,5 +82,105 @@ Entities::Entities(Dictionary entities, Dictionary entityConfig) {
         props->color.a = entity.get_or_add("alpha", 1.0);
         props->type = type;
         props->name = entity.get_or_add("name", id.capitalize());
+        props->traceName = Tracing::intern(id);
     }
 }
+
+void Entities::save(StreamPeerBuffer& out) const {
+    Array boidNames = boidConfigs.keys();
+    out.put_u32(boidNames.size());
+    for (int i = 0; i < boidNames.size(); ++i) {
+        out.put_utf8_string(boidNames[i]);
+        Ref<BoidProperties::BoidConfig>(boidConfigs[boidNames[i]])->save(out);
+    }
+
+    Array treeNames = behaviorTrees.keys();
+    out.put_u32(treeNames.size());
+    for (int i = 0; i < treeNames.size(); ++i) {
+        out.put_utf8_string(treeNames[i]);
+        Ref<BehaviorTree>(behaviorTrees[treeNames[i]])->save(out);
+    }
+
+    // Entity types refer to their boid config or tree by name, so types sharing one still do
+    Array ids = properties.keys();
+    out.put_u32(ids.size());
+    for (int i = 0; i < ids.size(); ++i) {
+        Ref<EntityProperties> props = properties[ids[i]];
+        out.put_utf8_string(ids[i]);
+        out.put_u8(props->type);
+        out.put_var(props->color);
+        out.put_utf8_string(props->name);
+        if (props->type == EntityProperties::BOID) {
+            auto* boid = Object::cast_to<BoidProperties>(props.ptr());
+            out.put_utf8_string(String(boidConfigs.find_key(boid->boidConfig)));
+        } else if (props->type == EntityProperties::BEHAVIOR) {
+            auto* behavior = Object::cast_to<BehaviorProperties>(props.ptr());
+            out.put_utf8_string(behavior->tree->name);
+            out.put_var(behavior->defaultBlackboardOverrides);
+        }
+    }
+}
+
+std::optional<Entities> Entities::load(StreamPeerBuffer& in) {
+    Entities result;
+
+    uint32_t boidCount = in.get_u32();
+    for (uint32_t i = 0; i < boidCount && in.get_available_bytes() > 0; ++i) {
+        String name = in.get_utf8_string();
+        result.boidConfigs[name] = BoidProperties::BoidConfig::load(in);
+    }
+
+    uint32_t treeCount = in.get_u32();
+    for (uint32_t i = 0; i < treeCount && in.get_available_bytes() > 0; ++i) {
+        String name = in.get_utf8_string();
+        result.behaviorTrees[name] = BehaviorTree::load(in);
+    }
+
+    uint32_t count = in.get_u32();
+    for (uint32_t i = 0; i < count; ++i) {
+        if (in.get_available_bytes() == 0) {
+            return std::nullopt;
+        }
+        String id = in.get_utf8_string();
+        auto type = static_cast<EntityProperties::EntityType>(in.get_u8());
+        Color color = in.get_var();
+        String name = in.get_utf8_string();
+
+        Ref<EntityProperties> props;
+        switch (type) {
+            case EntityProperties::STATIC:
+                props = Ref(memnew(EntityProperties));
+                break;
+            case EntityProperties::BOID: {
+                Ref<BoidProperties> boid = memnew(BoidProperties);
+                props = boid;
+                String config = in.get_utf8_string();
+                if (!result.boidConfigs.has(config)) {
+                    return std::nullopt;
+                }
+                boid->boidConfig = result.boidConfigs[config];
+                break;
+            }
+            case EntityProperties::BEHAVIOR: {
+                Ref<BehaviorProperties> behavior = memnew(BehaviorProperties);
+                props = behavior;
+                String config = in.get_utf8_string();
+                if (!result.behaviorTrees.has(config)) {
+                    return std::nullopt;
+                }
+                behavior->tree = result.behaviorTrees[config];
+                behavior->defaultBlackboardOverrides = in.get_var();
+                break;
+            }
+            default:
+                return std::nullopt;
+        }
+
+        result.properties[id] = props;
+        props->color = color;
+        props->type = type;
+        props->name = name;
+        props->traceName = Tracing::intern(id);
+    }
+    return result;
+}
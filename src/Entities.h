@@ -1,11 +1,15 @@
 #ifndef ENTITIES_H
 #define ENTITIES_H
 
+#include <optional>
+
 #include "godot_includes.h"
 
 struct EntityProperties : public Resource {
     Color color = Color{"#000000", 0.0};
     String name;
+    // The entity type's id, for trace zones
+    const char* traceName = "";
     enum EntityType {
         STATIC,
         BOID,
@@ -31,6 +35,8 @@ struct EntityProperties : public Resource {
 
 class Entities {
     Dictionary properties;
+    Dictionary boidConfigs;
+    Dictionary behaviorTrees;
 
     Dictionary parseBoidConfigs(Dictionary boidData);
     Dictionary parseBehaviorTrees(Dictionary behaviorData);
@@ -39,6 +45,12 @@ public:
     Entities() : Entities(Dictionary(), Dictionary()) {}
     Entities(Dictionary entities, Dictionary entityConfig);
 
+    // Writes the parsed entity types, boid configs and behavior trees, for ConfigCache
+    void save(StreamPeerBuffer& out) const;
+    // Rebuilds entities written by save() without parsing anything. Returns nothing if the data
+    // is invalid.
+    static std::optional<Entities> load(StreamPeerBuffer& in);
+
     Array getAllEntities() {
         return properties.keys();
     }
@@ -46,6 +58,11 @@ public:
     Ref<EntityProperties> getProperties(const StringName& entity) {
         return properties[entity];
     }
+
+    // Behavior trees by config name; entity types using the same config share one tree
+    Dictionary getBehaviorTrees() {
+        return behaviorTrees;
+    }
 };
 
 
@@ -1,5 +1,8 @@
 #include "GameManager.h"
 
+#include "BehaviorEntity.h"
+#include "Tracing.h"
+
 void GameManager::_bind_methods() {
     UtilityFunctions::print("Registering class ", get_class_static());
 
@@ -15,9 +18,79 @@ void GameManager::_bind_methods() {
     ClassDB::bind_method(D_METHOD("get_default_config"), &GameManager::getDefaultConfig);
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "default_config", PROPERTY_HINT_FILE), "set_default_config", "get_default_config");
 
+    ClassDB::bind_method(D_METHOD("set_autosave_enabled", "p_enabled"), &GameManager::setAutosaveEnabled);
+    ClassDB::bind_method(D_METHOD("is_autosave_enabled"), &GameManager::isAutosaveEnabled);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "autosave_enabled"), "set_autosave_enabled", "is_autosave_enabled");
+
+    ClassDB::bind_method(D_METHOD("set_autosave_interval", "p_interval"), &GameManager::setAutosaveInterval);
+    ClassDB::bind_method(D_METHOD("get_autosave_interval"), &GameManager::getAutosaveInterval);
+    ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "autosave_interval", PROPERTY_HINT_RANGE, "1, 600, or_greater, suffix:s"), "set_autosave_interval", "get_autosave_interval");
+
+    ClassDB::bind_method(D_METHOD("set_autosave_path", "p_path"), &GameManager::setAutosavePath);
+    ClassDB::bind_method(D_METHOD("get_autosave_path"), &GameManager::getAutosavePath);
+    ADD_PROPERTY(PropertyInfo(Variant::STRING, "autosave_path"), "set_autosave_path", "get_autosave_path");
+
+    ClassDB::bind_method(D_METHOD("set_watchdog_enabled", "p_enabled"), &GameManager::setWatchdogEnabled);
+    ClassDB::bind_method(D_METHOD("is_watchdog_enabled"), &GameManager::isWatchdogEnabled);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "watchdog_enabled"), "set_watchdog_enabled", "is_watchdog_enabled");
+
+    ClassDB::bind_method(D_METHOD("set_watchdog_threshold", "p_ms"), &GameManager::setWatchdogThreshold);
+    ClassDB::bind_method(D_METHOD("get_watchdog_threshold"), &GameManager::getWatchdogThreshold);
+    ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "watchdog_threshold", PROPERTY_HINT_RANGE, "1, 1000, or_greater, suffix:ms"), "set_watchdog_threshold", "get_watchdog_threshold");
+
+    ClassDB::bind_method(D_METHOD("set_watchdog_path", "p_path"), &GameManager::setWatchdogPath);
+    ClassDB::bind_method(D_METHOD("get_watchdog_path"), &GameManager::getWatchdogPath);
+    ADD_PROPERTY(PropertyInfo(Variant::STRING, "watchdog_path"), "set_watchdog_path", "get_watchdog_path");
+
+    ClassDB::bind_method(D_METHOD("set_threaded_simulation", "p_threaded"), &GameManager::setThreadedSimulation);
+    ClassDB::bind_method(D_METHOD("is_threaded_simulation"), &GameManager::isThreadedSimulation);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "threaded_simulation"), "set_threaded_simulation", "is_threaded_simulation");
+
+    ClassDB::bind_method(D_METHOD("set_seed", "p_seed"), &GameManager::setSeed);
+    ClassDB::bind_method(D_METHOD("get_seed"), &GameManager::getSeed);
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "seed"), "set_seed", "get_seed");
+
+    ClassDB::bind_method(D_METHOD("set_state_hashing", "p_enabled"), &GameManager::setStateHashing);
+    ClassDB::bind_method(D_METHOD("is_state_hashing"), &GameManager::isStateHashing);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "state_hashing"), "set_state_hashing", "is_state_hashing");
+
+    ClassDB::bind_method(D_METHOD("get_state_hash"), &GameManager::getStateHash);
+
+    ClassDB::bind_method(D_METHOD("set_profile_behavior", "p_enabled"), &GameManager::setProfileBehavior);
+    ClassDB::bind_method(D_METHOD("is_profiling_behavior"), &GameManager::isProfilingBehavior);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "profile_behavior"), "set_profile_behavior", "is_profiling_behavior");
+    ClassDB::bind_method(D_METHOD("print_behavior_profile", "p_reset"), &GameManager::printBehaviorProfile, DEFVAL(false));
+
+    ClassDB::bind_method(D_METHOD("set_simulation_threads", "p_threads"), &GameManager::setSimulationThreads);
+    ClassDB::bind_method(D_METHOD("get_simulation_threads"), &GameManager::getSimulationThreads);
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "simulation_threads", PROPERTY_HINT_RANGE, "1, 64"), "set_simulation_threads", "get_simulation_threads");
+
+    ClassDB::bind_method(D_METHOD("set_max_catch_up_ticks", "p_ticks"), &GameManager::setMaxCatchUpTicks);
+    ClassDB::bind_method(D_METHOD("get_max_catch_up_ticks"), &GameManager::getMaxCatchUpTicks);
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_catch_up_ticks", PROPERTY_HINT_RANGE, "1, 16, or_greater"), "set_max_catch_up_ticks", "get_max_catch_up_ticks");
+
+    ClassDB::bind_method(D_METHOD("set_frame_budget_split", "p_split"), &GameManager::setFrameBudgetSplit);
+    ClassDB::bind_method(D_METHOD("get_frame_budget_split"), &GameManager::getFrameBudgetSplit);
+    ADD_PROPERTY(PropertyInfo(Variant::VECTOR3, "frame_budget_split"), "set_frame_budget_split", "get_frame_budget_split");
+
+    ClassDB::bind_method(D_METHOD("get_scheduler_stats"), &GameManager::getSchedulerStats);
+    ClassDB::bind_method(D_METHOD("get_perf_counters"), &GameManager::getPerfCounters);
+    ClassDB::bind_method(D_METHOD("dump_trace", "p_file"), &GameManager::dumpTrace);
+
+    ClassDB::bind_method(D_METHOD("set_show_perf_overlay", "p_show"), &GameManager::setShowPerfOverlay);
+    ClassDB::bind_method(D_METHOD("is_showing_perf_overlay"), &GameManager::isShowingPerfOverlay);
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "show_perf_overlay"), "set_show_perf_overlay", "is_showing_perf_overlay");
+
     ClassDB::bind_method(D_METHOD("export_data", "p_file"), &GameManager::exportData);
     ClassDB::bind_method(D_METHOD("import_data", "p_file"), &GameManager::importData);
     ClassDB::bind_method(D_METHOD("import_config", "p_file", "undoable"), &GameManager::importConfig);
+    ClassDB::bind_method(D_METHOD("recover_autosave"), &GameManager::recoverAutosave);
+    ClassDB::bind_method(D_METHOD("run_benchmarks", "p_file"), &GameManager::runBenchmarks);
+    ClassDB::bind_method(D_METHOD("run_scaling_benchmark", "p_file", "p_max_size", "p_threads"), &GameManager::runScalingBenchmark, DEFVAL(4096), DEFVAL(PackedInt32Array()));
+    ClassDB::bind_method(D_METHOD("fast_forward", "p_config", "p_save", "p_ticks", "p_output"), &GameManager::fastForward);
+    ClassDB::bind_method(D_METHOD("start_journal", "p_file"), &GameManager::startJournal);
+    ClassDB::bind_method(D_METHOD("stop_journal"), &GameManager::stopJournal);
+    ClassDB::bind_method(D_METHOD("replay_journal", "p_file", "p_output"), &GameManager::replayJournal, DEFVAL(""));
 
     ClassDB::bind_method(D_METHOD("speed_changed"), &GameManager::speedChanged);
     ClassDB::bind_method(D_METHOD("undo"), &GameManager::undo);
@@ -33,24 +106,118 @@ int GameManager::getMaxUndoSaves() const { return maxUndoSaves; }
 void GameManager::setDefaultConfig(String p_file) { defaultConfig = p_file; }
 String GameManager::getDefaultConfig() const { return defaultConfig; }
 
-void GameManager::importConfig(String p_file, bool undoable) {
-    Ref<JSON> json = ResourceLoader::get_singleton()->load(p_file, "JSON");
-    if (json.is_null()) {
-        UtilityFunctions::printerr("Failed to load config file: ", p_file);
+void GameManager::setAutosaveEnabled(bool p_enabled) { autosaveEnabled = p_enabled; }
+bool GameManager::isAutosaveEnabled() const { return autosaveEnabled; }
+
+void GameManager::setAutosaveInterval(double p_interval) { autosaveInterval = p_interval; }
+double GameManager::getAutosaveInterval() const { return autosaveInterval; }
+
+void GameManager::setAutosavePath(String p_path) {
+    autosavePath = p_path;
+    if (!Engine::get_singleton()->is_editor_hint()) {
+        pushCommand(AutosavePathCommand{p_path});
+    }
+}
+String GameManager::getAutosavePath() const { return autosavePath; }
+
+void GameManager::setWatchdogEnabled(bool p_enabled) { watchdogEnabled = p_enabled; }
+bool GameManager::isWatchdogEnabled() const { return watchdogEnabled; }
+
+void GameManager::setWatchdogThreshold(double p_ms) { watchdogThreshold = p_ms; }
+double GameManager::getWatchdogThreshold() const { return watchdogThreshold; }
+
+void GameManager::setWatchdogPath(String p_path) {
+    watchdogPath = p_path;
+    if (!Engine::get_singleton()->is_editor_hint()) {
+        pushCommand(WatchdogPathCommand{p_path});
+    }
+}
+String GameManager::getWatchdogPath() const { return watchdogPath; }
+
+void GameManager::setThreadedSimulation(bool p_threaded) {
+    threadedSimulation = p_threaded;
+    if (!started) {
+        // Not running yet; _ready will set it up
         return;
     }
 
-    if (undoable) { saveState(); }
+    if (threadedSimulation) {
+        startSimulationThread();
+    } else {
+        stopSimulationThread();
+    }
+}
+bool GameManager::isThreadedSimulation() const { return threadedSimulation; }
+
+void GameManager::setSeed(int64_t p_seed) { seed = p_seed; }
+int64_t GameManager::getSeed() const { return seed; }
+
+void GameManager::setStateHashing(bool p_enabled) { stateHashing = p_enabled; }
+bool GameManager::isStateHashing() const { return stateHashing; }
+
+void GameManager::setProfileBehavior(bool p_enabled) { profileBehavior = p_enabled; }
+bool GameManager::isProfilingBehavior() const { return profileBehavior; }
 
-    Dictionary config = Dictionary(json->get_data());
-    Dictionary materials = config.get_or_add("materials", Dictionary());
-    Dictionary entities = config.get_or_add("entities", Dictionary());
-    Dictionary entityConfig = config.get_or_add("entityConfig", Dictionary());
+void GameManager::setSimulationThreads(int p_threads) { simulationThreads = Math::max(p_threads, 1); }
+int GameManager::getSimulationThreads() const { return simulationThreads; }
 
-    Materials mats(materials);
-    Entities ents(entities, entityConfig);
-    gameState->setConfig(p_file, mats, ents);
-    selectionMenu->setContents(mats, ents);
+void GameManager::printBehaviorProfile(bool p_reset) {
+    pushCommand(PrintBehaviorProfileCommand{p_reset});
+}
+
+int64_t GameManager::getStateHash() const {
+    return static_cast<int64_t>(publishedStateHash.load());
+}
+
+void GameManager::setMaxCatchUpTicks(int p_ticks) { scheduler.setMaxCatchUpTicks(p_ticks); }
+int GameManager::getMaxCatchUpTicks() const { return scheduler.getMaxCatchUpTicks(); }
+
+// Shares of the frame time given to the tile simulation, the entity simulation and rendering
+void GameManager::setFrameBudgetSplit(Vector3 p_split) {
+    double total = p_split.x + p_split.y + p_split.z;
+    if (total <= 0.0) {
+        UtilityFunctions::printerr("Frame budget split must be positive: ", p_split);
+        return;
+    }
+    scheduler.setBudgetShare(TickScheduler::TILES, p_split.x / total);
+    scheduler.setBudgetShare(TickScheduler::ENTITIES, p_split.y / total);
+    scheduler.setBudgetShare(TickScheduler::RENDER, p_split.z / total);
+}
+Vector3 GameManager::getFrameBudgetSplit() const {
+    return {
+        static_cast<real_t>(scheduler.getBudgetShare(TickScheduler::TILES)),
+        static_cast<real_t>(scheduler.getBudgetShare(TickScheduler::ENTITIES)),
+        static_cast<real_t>(scheduler.getBudgetShare(TickScheduler::RENDER))
+    };
+}
+
+Dictionary GameManager::getSchedulerStats() const {
+    Dictionary stats;
+    stats["ticks"] = scheduler.getTicks();
+    stats["dropped_ticks"] = scheduler.getDroppedTicks();
+    stats["tile_overruns"] = scheduler.getOverruns(TickScheduler::TILES);
+    stats["entity_overruns"] = scheduler.getOverruns(TickScheduler::ENTITIES);
+    stats["render_overruns"] = scheduler.getOverruns(TickScheduler::RENDER);
+    return stats;
+}
+
+void GameManager::importConfig(String p_file, bool undoable) {
+    pushCommand(LoadConfigCommand{p_file, undoable});
+}
+
+bool GameManager::applyConfig(const String& file, bool undoable) {
+    TRACE_ZONE("GameManager::applyConfig");
+    std::optional<ConfigCache::Entry> config = configCache.load(file);
+    if (!config) {
+        UtilityFunctions::printerr("Failed to load config file: ", file);
+        return false;
+    }
+
+    if (undoable) { saveState(); }
+
+    gameState->setConfig(file, config->materials, config->entities);
+    publishMenuContents();
+    return true;
 }
 
 void GameManager::saveState() {
@@ -62,10 +229,347 @@ void GameManager::saveState() {
 
 void GameManager::speedChanged() {
     double speed = selectionMenu->getSimulationSpeed();
-    gameState->setSimSpeed(speed, speed/baseSimSpeed);
+    pushCommand(SpeedCommand{speed, speed/baseSimSpeed});
 }
 
 void GameManager::undo() {
+    pushCommand(UndoCommand{});
+}
+
+void GameManager::clearGrid() {
+    pushCommand(ClearCommand{});
+}
+
+void GameManager::exportData(String p_file) {
+    pushCommand(ExportDataCommand{p_file});
+}
+
+void GameManager::importData(String p_file) {
+    Ref<JSON> json = ResourceLoader::get_singleton()->load(p_file, "JSON");
+    if (json.is_null()) {
+        UtilityFunctions::printerr("Failed to load config file: ", p_file);
+        return;
+    }
+    pushCommand(ImportDataCommand{json});
+}
+
+void GameManager::recoverAutosave() {
+    pushCommand(RecoverAutosaveCommand{});
+}
+
+Dictionary GameManager::fastForward(String p_config, String p_save, int p_ticks, String p_output) {
+    // Everything runs right here, so take the state back from the simulation thread
+    bool wasThreaded = simulationRunning;
+    stopSimulationThread();
+    processCommands();
+
+    Dictionary stats;
+    auto run = [&] {
+        if (!p_save.is_empty()) {
+            Ref<JSON> json = ResourceLoader::get_singleton()->load(p_save, "JSON");
+            if (json.is_null()) {
+                UtilityFunctions::printerr("Failed to load data file: ", p_save);
+                return;
+            }
+            saveState();
+            gameState->importData(json);
+        }
+        if (!p_config.is_empty() && !applyConfig(p_config, p_save.is_empty())) {
+            return;
+        }
+
+        // Restart the sequence so the same save and seed always give the same result
+        if (int64_t fixedSeed = seed; fixedSeed != 0) {
+            gameState->setSeed(fixedSeed);
+        }
+        gameState->setHashing(stateHashing);
+        gameState->setProfilingBehavior(profileBehavior);
+        gameState->setSimulationThreads(simulationThreads);
+
+        // One entity update per tile tick, as at the default speed
+        double entityDelta = 1.0 / baseSimSpeed;
+        Time* time = Time::get_singleton();
+        uint64_t tileUsec = 0;
+        uint64_t entityUsec = 0;
+        for (int i = 0; i < p_ticks; ++i) {
+            uint64_t start = time->get_ticks_usec();
+            gameState->processTiles();
+            uint64_t mid = time->get_ticks_usec();
+            gameState->processEntities(entityDelta);
+            tileUsec += mid - start;
+            entityUsec += time->get_ticks_usec() - mid;
+        }
+
+        Vector2i size = gameState->getDimensions();
+        double seconds = (tileUsec + entityUsec) / 1e6;
+        stats["ticks"] = p_ticks;
+        stats["size"] = size;
+        stats["entities"] = static_cast<int64_t>(gameState->getEntityInstances().size());
+        stats["seconds"] = seconds;
+        stats["tile_seconds"] = tileUsec / 1e6;
+        stats["entity_seconds"] = entityUsec / 1e6;
+        stats["ticks_per_second"] = seconds > 0.0 ? p_ticks / seconds : 0.0;
+        stats["ns_per_cell"] = p_ticks > 0 ? tileUsec * 1e3 / (static_cast<double>(p_ticks) * size.x * size.y) : 0.0;
+        publishedStateHash = gameState->getStateHash();
+        if (stateHashing) {
+            stats["state_hash"] = String::num_uint64(gameState->getStateHash(), 16);
+        }
+
+        if (p_output.is_empty()) {
+            return;
+        }
+        if (ResourceSaver::get_singleton()->save(gameState->exportData(), p_output) != OK) {
+            UtilityFunctions::printerr("Failed to save data to file: ", p_output);
+        }
+        String statsFile = p_output.get_basename() + ".stats.json";
+        Ref<FileAccess> file = FileAccess::open(statsFile, FileAccess::WRITE);
+        if (file.is_null()) {
+            UtilityFunctions::printerr("Failed to save fast-forward stats to file: ", statsFile);
+            return;
+        }
+        file->store_string(JSON::stringify(stats, "\t"));
+    };
+    run();
+    // The state no longer follows from the watchdog's baseline
+    watchdogBaseline.reset();
+
+    if (wasThreaded) {
+        startSimulationThread();
+    }
+    return stats;
+}
+
+bool GameManager::dumpTrace(String p_file) {
+    return Tracing::writeChromeTrace(p_file);
+}
+
+Dictionary GameManager::getPerfCounters() {
+    Dictionary result;
+    {
+        std::lock_guard lock(countersMutex);
+        result = publishedCounters.toDictionary();
+    }
+    result["render_ms"] = renderSeconds * 1e3;
+    // Loads that ran the parsers vs ones built from the cached blob
+    ConfigCache::Stats configStats = configCache.getStats();
+    result["configs_parsed"] = configStats.parsed;
+    result["configs_from_cache"] = configStats.fromBlob;
+    return result;
+}
+
+void GameManager::setShowPerfOverlay(bool p_show) {
+    showPerfOverlay = p_show;
+    if (perfOverlay) {
+        perfOverlay->set_visible(showPerfOverlay);
+    }
+}
+bool GameManager::isShowingPerfOverlay() const { return showPerfOverlay; }
+
+void GameManager::updatePerfOverlay(double delta) {
+    if (!perfOverlay || !showPerfOverlay) {
+        return;
+    }
+
+    // Readable, and cheap enough to leave on
+    timeSinceOverlayUpdate += delta;
+    if (timeSinceOverlayUpdate < 0.25) {
+        return;
+    }
+    timeSinceOverlayUpdate = 0.0;
+
+    Dictionary counters = getPerfCounters();
+    String text = String("tiles: {tile_ms} ms ({tile_ticks} ticks, {tiles_moved} moved, {active_chunks} active chunks)\n"
+                         "entities: {entity_ms} ms ({behavior_nodes} behavior nodes, {dead_entities} died)\n"
+                         "render: {render_ms} ms\n").format(counters);
+    Dictionary entities = counters["entities"];
+    Array types = entities.keys();
+    for (int i = 0; i < types.size(); ++i) {
+        text += String("{0}: {1}\n").format(Array::make(types[i], entities[types[i]]));
+    }
+    perfOverlay->set_text(text);
+}
+
+void GameManager::startJournal(String p_file) {
+    pushCommand(RecordJournalCommand{p_file});
+}
+
+void GameManager::stopJournal() {
+    pushCommand(RecordJournalCommand{});
+}
+
+Dictionary GameManager::replayJournal(String p_file, String p_output) {
+    bool wasThreaded = simulationRunning;
+    stopSimulationThread();
+    processCommands();
+
+    // Don't record the replay into a journal that is being recorded
+    std::unique_ptr<InputJournal::Writer> recording = std::move(journal);
+
+    Dictionary stats;
+    InputJournal::Reader reader;
+    if (reader.open(p_file)) {
+        saveState();
+        // The snapshot brings its own config, and the random state picks the recorded sequence up
+        // exactly where it was
+        gameState->loadSnapshot(reader.snapshot);
+        gameState->setRandom(reader.random);
+        // Hashed journals are checked frame by frame
+        gameState->setHashing(stateHashing || reader.hashed);
+        gameState->setProfilingBehavior(profileBehavior);
+        gameState->setSimulationThreads(simulationThreads);
+
+        Time* time = Time::get_singleton();
+        uint64_t usec = 0;
+        int64_t frames = 0;
+        int64_t tileTicks = 0;
+        int64_t divergedAt = -1;
+        while (std::optional<InputJournal::Record> record = reader.next()) {
+            if (auto* command = std::get_if<Command>(&*record)) {
+                std::visit([this](auto& c) { apply(c); }, *command);
+                continue;
+            }
+
+            const auto& frame = std::get<InputJournal::Frame>(*record);
+            uint64_t start = time->get_ticks_usec();
+            gameState->step(frame.tileTicks, frame.delta);
+            usec += time->get_ticks_usec() - start;
+            if (reader.hashed && divergedAt == -1 && gameState->getStateHash() != frame.stateHash) {
+                UtilityFunctions::printerr("Replay no longer matches the recording after frame ", frames, ": ", p_file);
+                divergedAt = frames;
+            }
+            ++frames;
+            tileTicks += frame.tileTicks;
+        }
+
+        stats["frames"] = frames;
+        stats["tile_ticks"] = tileTicks;
+        stats["seconds"] = usec / 1e6;
+        stats["frames_per_second"] = usec > 0 ? frames * 1e6 / usec : 0.0;
+        if (reader.hashed) {
+            // The first frame after which the state differed from the recording, or -1
+            stats["diverged_at_frame"] = divergedAt;
+        }
+        publishedStateHash = gameState->getStateHash();
+        if (gameState->isHashing()) {
+            stats["state_hash"] = String::num_uint64(gameState->getStateHash(), 16);
+        }
+
+        if (!p_output.is_empty() && ResourceSaver::get_singleton()->save(gameState->exportData(), p_output) != OK) {
+            UtilityFunctions::printerr("Failed to save data to file: ", p_output);
+        }
+    }
+
+    journal = std::move(recording);
+    watchdogBaseline.reset();
+    if (wasThreaded) {
+        startSimulationThread();
+    }
+    return stats;
+}
+
+void GameManager::runBenchmarks(String p_file) {
+    std::optional<ConfigCache::Entry> config = configCache.load(defaultConfig);
+    if (!config) {
+        UtilityFunctions::printerr("Failed to load config file: ", defaultConfig);
+        return;
+    }
+
+    Array results = Benchmarks(defaultConfig, config->materials, config->entities).run();
+
+    Ref<FileAccess> file = FileAccess::open(p_file, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("Failed to save benchmark results to file: ", p_file);
+        return;
+    }
+    file->store_string(JSON::stringify(results, "\t"));
+}
+
+void GameManager::runScalingBenchmark(String p_file, int p_max_size, PackedInt32Array p_threads) {
+    std::vector<ScalingBenchmark::Config> configs;
+    for (const String& file : {String("res://config.json"), String("res://coral.json")}) {
+        std::optional<ConfigCache::Entry> config = configCache.load(file);
+        if (!config) {
+            UtilityFunctions::printerr("Failed to load config file: ", file);
+            continue;
+        }
+        configs.push_back({file, config->materials, config->entities});
+        // Also run each config in MARGOLUS mode, the only one the thread counts apply to
+        if (config->materials.getTable().getMode() != MaterialTable::MARGOLUS) {
+            Materials margolus = config->materials;
+            margolus.setMode(MaterialTable::MARGOLUS);
+            configs.push_back({file, margolus, config->entities});
+        }
+    }
+
+    ScalingBenchmark benchmark(std::move(configs));
+    std::erase_if(benchmark.sizes, [&](int size) { return size > p_max_size; });
+    if (!p_threads.is_empty()) {
+        benchmark.threadCounts.clear();
+        for (int i = 0; i < p_threads.size(); ++i) {
+            benchmark.threadCounts.push_back(p_threads[i]);
+        }
+    }
+    benchmark.run(p_file);
+}
+
+void GameManager::pushCommand(Command&& command) {
+    if (!commands.push(std::move(command))) {
+        UtilityFunctions::printerr("Command queue is full; dropping command");
+    }
+}
+
+void GameManager::processCommands() {
+    Command command;
+    while (commands.pop(command)) {
+        if (journal) {
+            journal->record(command);
+        }
+        if (watchdogBaseline) {
+            watchdogRecords.push_back(command);
+        }
+        std::visit([this](auto& c) { apply(c); }, command);
+        // Undos and recoveries bring back states from before the baseline, so start a new one
+        if (std::holds_alternative<UndoCommand>(command) || std::holds_alternative<RecoverAutosaveCommand>(command)) {
+            watchdogBaseline.reset();
+        }
+    }
+}
+
+void GameManager::apply(PaintCommand& command) {
+    if (command.beginsStroke) {
+        saveState();
+    }
+    gameState->paint(command.material, command.cells);
+}
+
+void GameManager::apply(SpawnCommand& command) {
+    saveState();
+    gameState->spawnEntity(command.position, command.type);
+}
+
+void GameManager::apply(ClearCommand& command) {
+    saveState();
+    gameState->clearGrid();
+}
+
+void GameManager::apply(LoadConfigCommand& command) {
+    applyConfig(command.file, command.undoable);
+}
+
+void GameManager::apply(ImportDataCommand& command) {
+    saveState();
+    gameState->importData(command.data);
+}
+
+void GameManager::apply(ExportDataCommand& command) {
+    TRACE_ZONE("GameManager::exportData");
+    Error e = ResourceSaver::get_singleton()->save(gameState->exportData(), command.file);
+    if (e != OK) {
+        UtilityFunctions::printerr("Failed to save data to file: ", command.file);
+    }
+}
+
+void GameManager::apply(UndoCommand& command) {
     if (previousStates.empty()) {
         return;
     }
@@ -73,31 +577,184 @@ void GameManager::undo() {
     std::unique_ptr<GameState> previous = std::move(previousStates.back());
     previousStates.pop_back();
     gameState = std::move(previous);
-    selectionMenu->setContents(gameState->getMaterials(), gameState->getEntities());
-    speedChanged();
+    gameState->setSimSpeed(tileSpeed, entitySpeed);
+    publishMenuContents();
 }
 
-void GameManager::clearGrid() {
-    saveState();
-    gameState->clearGrid();
+void GameManager::apply(SpeedCommand& command) {
+    tileSpeed = command.tileSpeed;
+    entitySpeed = command.entitySpeed;
+    gameState->setSimSpeed(tileSpeed, entitySpeed);
 }
 
-void GameManager::exportData(String p_file) {
-    Error e = ResourceSaver::get_singleton()->save(gameState->exportData(), p_file);
-    if (e != OK) {
-        UtilityFunctions::printerr("Failed to save data to file: ", p_file);
+void GameManager::apply(RecoverAutosaveCommand& command) {
+    restoreAutosave();
+}
+
+void GameManager::apply(PrintBehaviorProfileCommand& command) {
+    Dictionary trees = gameState->getEntities().getBehaviorTrees();
+    Array names = trees.keys();
+    for (int i = 0; i < names.size(); ++i) {
+        Ref<BehaviorTree> tree = trees[names[i]];
+        UtilityFunctions::print("Behavior tree '", tree->name, "':");
+        tree->root->print(0, true);
+        if (command.reset) {
+            tree->root->resetStats();
+        }
     }
 }
 
-void GameManager::importData(String p_file) {
-    Ref<JSON> json = ResourceLoader::get_singleton()->load(p_file, "JSON");
-    if (json.is_null()) {
-        UtilityFunctions::printerr("Failed to load config file: ", p_file);
+void GameManager::apply(AutosavePathCommand& command) {
+    activeAutosavePath = command.path;
+    // Keep autosaving, into the new place
+    if (autosave) {
+        autosave = std::make_unique<Autosave>(activeAutosavePath);
+        autosave->start(*gameState);
+    }
+}
+
+void GameManager::apply(WatchdogPathCommand& command) {
+    activeWatchdogPath = command.path;
+}
+
+void GameManager::apply(RecordJournalCommand& command) {
+    journal.reset();
+    if (command.file.is_empty()) {
+        return;
+    }
+
+    gameState->setHashing(stateHashing);
+
+    journal = std::make_unique<InputJournal::Writer>();
+    if (!journal->open(command.file, *gameState)) {
+        journal.reset();
         return;
     }
+    // The entity speed isn't part of the snapshot
+    journal->record(SpeedCommand{tileSpeed, entitySpeed});
+}
+
+void GameManager::publishMenuContents() {
+    std::lock_guard lock(menuMutex);
+    pendingMenuContents.emplace(gameState->getMaterials(), gameState->getEntities());
+}
+
+bool GameManager::restoreAutosave() {
     saveState();
-    Vector2i newSize = gameState->importData(json);
-    image->resize(newSize.x, newSize.y);
+
+    Autosave fallback(activeAutosavePath);
+    Autosave* source = autosave ? autosave.get() : &fallback;
+    if (!source->recover(*gameState)) {
+        UtilityFunctions::printerr("No autosave to recover from: ", activeAutosavePath);
+        previousStates.pop_back();
+        return false;
+    }
+
+    // Start a fresh log from the recovered state
+    if (autosave) {
+        autosave->start(*gameState);
+    }
+    return true;
+}
+
+void GameManager::updateAutosave(double delta) {
+    if (autosaveEnabled && !autosave) {
+        autosave = std::make_unique<Autosave>(activeAutosavePath);
+        autosave->start(*gameState);
+    } else if (!autosaveEnabled && autosave) {
+        autosave.reset();
+    }
+
+    if (autosave) {
+        timeSinceAutosave += delta;
+        if (timeSinceAutosave >= autosaveInterval) {
+            timeSinceAutosave = 0.0;
+            autosave->checkpoint(*gameState);
+        }
+    }
+}
+
+void GameManager::tick(double delta) {
+    TRACE_ZONE("GameManager::tick");
+    processCommands();
+    // A hashed journal stores every frame's hash, so hashing stays on while it records. The watchdog's
+    // captures are always hashed, so their replays can confirm they reproduced the slow tick.
+    bool watching = watchdogEnabled && !journal;
+    gameState->setHashing(stateHashing || (journal && journal->isHashed()) || watching);
+    gameState->setProfilingBehavior(profileBehavior);
+    gameState->setSimulationThreads(simulationThreads);
+
+    updateWatchdogBaseline(delta, watching);
+
+    Time* time = Time::get_singleton();
+    uint64_t start = time->get_ticks_usec();
+    int tileTicks = gameState->process(delta, scheduler);
+    double ms = (time->get_ticks_usec() - start) / 1e3;
+    if (journal) {
+        journal->endFrame(tileTicks, delta, gameState->getStateHash());
+    }
+    if (watchdogBaseline) {
+        watchdogRecords.push_back(InputJournal::Frame{tileTicks, delta, gameState->getStateHash()});
+        if (ms > watchdogThreshold) {
+            captureSlowTick(ms);
+        }
+    }
+    {
+        std::lock_guard lock(countersMutex);
+        publishedCounters = gameState->getCounters();
+    }
+    publishedStateHash = gameState->getStateHash();
+    updateAutosave(delta);
+}
+
+void GameManager::updateWatchdogBaseline(double delta, bool watching) {
+    if (!watching) {
+        watchdogBaseline.reset();
+        return;
+    }
+
+    timeSinceWatchdogBaseline += delta;
+    if (watchdogBaseline && timeSinceWatchdogBaseline < WATCHDOG_BASELINE_INTERVAL) {
+        return;
+    }
+
+    // The copy has the random state too, so the live run carries on undisturbed
+    timeSinceWatchdogBaseline = 0.0;
+    watchdogBaseline = gameState->clone();
+    watchdogRecords.clear();
+    // The entity speed isn't part of the snapshot
+    watchdogRecords.push_back(Command{SpeedCommand{tileSpeed, entitySpeed}});
+}
+
+void GameManager::captureSlowTick(double ms) {
+    // Only one capture is written at a time
+    if (watchdogCapture.valid() && watchdogCapture.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+
+    String file = activeWatchdogPath + "_" + Time::get_singleton()->get_datetime_string_from_system().replace(":", "-") + ".fbj";
+    UtilityFunctions::print("Slow tick (", ms, " ms); saving it and the ticks before it to ", file);
+
+    // The writer takes the baseline; the next tick starts a new one
+    watchdogCapture = std::async(std::launch::async,
+            [baseline = std::move(watchdogBaseline), records = std::move(watchdogRecords), file] {
+        InputJournal::Writer writer;
+        if (!writer.open(file, *baseline)) {
+            return;
+        }
+        for (const InputJournal::Record& record : records) {
+            if (const auto* frame = std::get_if<InputJournal::Frame>(&record)) {
+                writer.endFrame(frame->tileTicks, frame->delta, frame->stateHash);
+            } else {
+                writer.record(std::get<Command>(record));
+            }
+        }
+
+        if (Tracing::isEnabled()) {
+            Tracing::writeChromeTrace(file.get_basename() + ".trace.json");
+        }
+    });
+    watchdogRecords.clear();
 }
 
 void GameManager::_ready() {
@@ -105,7 +762,14 @@ void GameManager::_ready() {
         return;
     }
 
-    gameState = std::make_unique<GameState>(this, gridSize, 0, 1.0);
+    Tracing::setThreadName("main");
+    gameState = std::make_unique<GameState>(this, gridSize, tileSpeed, entitySpeed);
+    started = true;
+    int64_t fixedSeed = seed;
+    uint64_t initialSeed = fixedSeed != 0 ? fixedSeed : UtilityFunctions::randi();
+    gameState->setSeed(initialSeed);
+    brushRandom.seedWith(initialSeed, 1);
+    scheduler.setFrameBudget(1.0 / Engine::get_singleton()->get_physics_ticks_per_second());
 
     selectionMenu = get_node<SelectionMenu>("%SelectionMenu");
     DEV_ASSERT(selectionMenu);
@@ -127,6 +791,10 @@ void GameManager::_ready() {
     canvas = get_node<MeshInstance2D>("%Canvas");
     DEV_ASSERT(canvas);
 
+    // Optional
+    perfOverlay = Object::cast_to<Label>(get_node_or_null("%PerfOverlay"));
+    setShowPerfOverlay(showPerfOverlay);
+
     PackedByteArray arr;
     arr.resize(4);
 
@@ -134,24 +802,92 @@ void GameManager::_ready() {
     image->set_data(1,1, false, Image::FORMAT_RGBA8, arr);
     image->resize(gridSize.x, gridSize.y);
 
+    // Nothing else owns the state yet, so apply the initial setup right away
+    processCommands();
+
+    if (runCommandLine()) {
+        get_tree()->quit();
+        return;
+    }
+
+    if (autosaveEnabled) {
+        autosave = std::make_unique<Autosave>(activeAutosavePath);
+        if (!autosave->hasData() || !restoreAutosave()) {
+            autosave->start(*gameState);
+        }
+    }
+
+    if (threadedSimulation) {
+        startSimulationThread();
+    }
 }
 
 void GameManager::_physics_process(double delta) {
+    TRACE_ZONE("GameManager::_physics_process");
     if (Engine::get_singleton()->is_editor_hint()) {
         return;
     }
 
     handleMouseInput(delta);
-    gameState->process(delta);
+    if (!simulationRunning) {
+        tick(delta);
+    }
+}
+
+void GameManager::_exit_tree() {
+    stopSimulationThread();
+    if (watchdogCapture.valid()) {
+        watchdogCapture.wait();
+    }
+
+    if (autosave) {
+        autosave->checkpoint(*gameState);
+    }
 }
 
 void GameManager::_process(double delta) {
+    TRACE_ZONE("GameManager::_process");
     if (Engine::get_singleton()->is_editor_hint()) {
         return;
     }
 
+    std::optional<std::pair<Materials, Entities>> menuContents;
+    {
+        std::lock_guard lock(menuMutex);
+        menuContents.swap(pendingMenuContents);
+    }
+    if (menuContents) {
+        selectionMenu->setContents(menuContents->first, menuContents->second);
+    }
+
+    updatePerfOverlay(delta);
+
+    // Rendering made the last frame run long, so give this one to the simulation
+    if (skipNextRender) {
+        skipNextRender = false;
+        return;
+    }
+
     DEV_ASSERT(image.is_valid());
-    gameState->generateFrame(image);
+    uint64_t start = Time::get_singleton()->get_ticks_usec();
+    if (simulationRunning) {
+        if (!frames.acquire()) {
+            // The simulation hasn't finished a tick since the last frame
+            return;
+        }
+        frames.readBuffer().render(image);
+    } else {
+        gameState->generateFrame(image);
+    }
+    renderSeconds = (Time::get_singleton()->get_ticks_usec() - start) / 1e6;
+    bool renderOverran = !scheduler.record(TickScheduler::RENDER, renderSeconds);
+    // Skipping a render only gives time back to the simulation when both run on this thread, and
+    // is only worth a dropped frame when the frame as a whole went over, not just the render's share
+    skipNextRender = false;
+    if (renderOverran && !simulationRunning) {
+        const PerfCounters& counters = gameState->getCounters();
+        skipNextRender = scheduler.overran(counters.tileSeconds + counters.entitySeconds + renderSeconds);
+    }
     Ref<ImageTexture> texture = canvas->get_texture();
     DEV_ASSERT(texture.is_valid());
     texture->set_image(image);
@@ -162,7 +898,8 @@ void GameManager::handleMouseInput(double delta) {
     isMouseDown = Input::get_singleton()->is_mouse_button_pressed(MOUSE_BUTTON_LEFT);
 
     if (isMouseDown) {
-        Vector2i size = gameState->getDimensions();
+        // The grid as last drawn, which is what the user is pointing at
+        Vector2i size = image->get_size();
 
         double brushRadius = selectionMenu->getBrushRadius() - 1;
         double brushDensity = selectionMenu->getBrushDensity();
@@ -177,28 +914,105 @@ void GameManager::handleMouseInput(double delta) {
             return;
         }
 
-        if (!wasMouseDown) {
-            saveState();
-        }
-
         if (selectionMenu->isEntitySelected()) {
             if (!wasMouseDown) {
-                gameState->spawnEntity(mousePos, type);
+                pushCommand(SpawnCommand{type, mousePos});
             }
             return;
         }
 
+        PaintCommand stroke{type, {}, !wasMouseDown};
         for (int x = -brushRadius; x <= brushRadius; ++x) {
             for (int y = -brushRadius; y <= brushRadius; ++y) {
                 if (x*x + y*y > brushRadius*brushRadius) {
                     continue;
                 }
 
-                if (autoFill || UtilityFunctions::randf() < brushDensity * delta) {
-                    Vector2i pos = mousePos + Vector2i(x, y);
-                    gameState->setTile(pos, Pixel{type});
+                if (autoFill || brushRandom.uniform() < brushDensity * delta) {
+                    stroke.cells.push_back(mousePos + Vector2i(x, y));
                 }
             }
         }
+        pushCommand(std::move(stroke));
+    }
+}
+
+// For example:
+//   godot --headless res://main.tscn -- --fast-forward=100000 --save=res://tank.json --output=user://tank_100k.json
+//   godot --headless res://main.tscn -- --replay=user://session.fbj --output=user://replayed.json
+//   godot --headless res://main.tscn -- --benchmark=user://benchmarks.json
+//   godot --headless res://main.tscn -- --scaling-benchmark=user://scaling.csv --max-size=1024 --threads=1,2,4
+bool GameManager::runCommandLine() {
+    Dictionary args;
+    PackedStringArray userArgs = OS::get_singleton()->get_cmdline_user_args();
+    for (int i = 0; i < userArgs.size(); ++i) {
+        String arg = userArgs[i];
+        if (arg.begins_with("--")) {
+            args[arg.get_slice("=", 0).trim_prefix("--")] = arg.contains("=") ? arg.get_slice("=", 1) : "";
+        }
+    }
+
+    if (args.has("benchmark")) {
+        runBenchmarks(args["benchmark"]);
+        return true;
+    }
+
+    if (args.has("scaling-benchmark")) {
+        PackedInt32Array threads;
+        if (args.has("threads")) {
+            threads = String(args["threads"]).split_ints(",");
+        }
+        runScalingBenchmark(args["scaling-benchmark"], String(args.get("max-size", "4096")).to_int(), threads);
+        return true;
+    }
+
+    if (args.has("replay")) {
+        Dictionary stats = replayJournal(args["replay"], args.get("output", ""));
+        UtilityFunctions::print(JSON::stringify(stats));
+        return true;
+    }
+
+    if (args.has("fast-forward")) {
+        Dictionary stats = fastForward(args.get("config", ""), args.get("save", ""),
+                                       String(args["fast-forward"]).to_int(), args.get("output", "user://fast_forward.json"));
+        UtilityFunctions::print(JSON::stringify(stats));
+        return true;
+    }
+    return false;
+}
+
+void GameManager::startSimulationThread() {
+    if (simulationRunning) {
+        return;
+    }
+    simulationRunning = true;
+    simulationThread = std::thread(&GameManager::runSimulation, this, Engine::get_singleton()->get_physics_ticks_per_second());
+}
+
+void GameManager::stopSimulationThread() {
+    if (!simulationRunning) {
+        return;
+    }
+    simulationRunning = false;
+    simulationThread.join();
+}
+
+void GameManager::runSimulation(int ticksPerSecond) {
+    Tracing::setThreadName("simulation");
+    using Clock = std::chrono::steady_clock;
+    const auto tickInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / ticksPerSecond));
+
+    auto lastTick = Clock::now();
+    while (simulationRunning) {
+        auto now = Clock::now();
+        double delta = std::chrono::duration<double>(now - lastTick).count();
+        lastTick = now;
+
+        tick(delta);
+        gameState->captureFrame(frames.writeBuffer());
+        frames.publish();
+
+        // When a tick runs long, start the next one right away
+        std::this_thread::sleep_until(now + tickInterval);
     }
 }
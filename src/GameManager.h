@@ -1,12 +1,25 @@
 #ifndef GAMEMANAGER_H
 #define GAMEMANAGER_H
 
+#include <atomic>
 #include <deque>
-
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "Autosave.h"
+#include "Benchmarks.h"
+#include "Commands.h"
+#include "ConfigCache.h"
+#include "InputJournal.h"
 #include "GameState.h"
 #include "godot_includes.h"
+#include "ScalingBenchmark.h"
 #include "SelectionMenu.h"
 #include "FileMenu.h"
+#include "SpscRing.h"
+#include "TickScheduler.h"
+#include "TripleBuffer.h"
 
 class GameManager : public Node2D {
     GDCLASS(GameManager, Node2D)
@@ -14,22 +27,122 @@ class GameManager : public Node2D {
     SelectionMenu* selectionMenu = nullptr;
     FileMenu* fileMenu = nullptr;
 
+    // Owned by the simulation thread while it runs, and by the main thread otherwise.
+    // The main thread only changes it through commands.
     std::unique_ptr<GameState> gameState{};
     std::deque<std::unique_ptr<GameState>> previousStates{};
+    SpscRing<Command> commands{1024};
 
     Vector2i gridSize = {50, 50};
     double baseSimSpeed = 15.0;
+    double tileSpeed = 0.0;
+    double entitySpeed = 1.0;
     int maxUndoSaves = 5;
 
+    // Caps how much work one frame may take; see TickScheduler
+    TickScheduler scheduler{};
+    bool skipNextRender = false;
+
     bool isMouseDown = false;
 
+    // 0 picks a random seed. With a fixed seed (and the same inputs) runs are bit-identical,
+    // which the state hash can confirm.
+    std::atomic<int64_t> seed = 0;
+    std::atomic<bool> stateHashing = false;
+    std::atomic<bool> profileBehavior = false;
+    std::atomic<int> simulationThreads = 1;
+    Random brushRandom;
+
     MeshInstance2D* canvas = nullptr;
     Ref<Image> image;
 
     String defaultConfig = "res://config.json";
+    ConfigCache configCache{};
+
+    std::atomic<bool> autosaveEnabled = false;
+    std::atomic<double> autosaveInterval = 30.0;
+    // Set on the main thread; the simulation thread gets its own copy through an AutosavePathCommand
+    String autosavePath = "user://autosave";
+    String activeAutosavePath = autosavePath;
+    std::unique_ptr<Autosave> autosave{};
+    double timeSinceAutosave = 0.0;
+
+    // Saves any tick that takes longer than the threshold as an input journal, which --replay can run
+    // again. The journal starts from a baseline: a copy of the state, random state included, taken
+    // every WATCHDOG_BASELINE_INTERVAL seconds (and after undos and autosave recoveries). Everything
+    // since the baseline is kept in memory and only written out when a tick is slow. Ticks recorded
+    // by a journal are left alone.
+    static constexpr double WATCHDOG_BASELINE_INTERVAL = 10.0;
+    std::atomic<bool> watchdogEnabled = false;
+    std::atomic<double> watchdogThreshold = 50.0; // ms
+    String watchdogPath = "user://slow_tick";
+    String activeWatchdogPath = watchdogPath;
+    std::unique_ptr<GameState> watchdogBaseline{};
+    std::vector<InputJournal::Record> watchdogRecords{};
+    double timeSinceWatchdogBaseline = 0.0;
+    std::future<void> watchdogCapture;
+
+    // When enabled, GameState::process runs on simulationThread and _process renders the latest
+    // published frame
+    bool threadedSimulation = false;
+    // Set by _ready once gameState exists. The main thread checks this rather than gameState, which
+    // the simulation thread may be replacing.
+    bool started = false;
+    std::thread simulationThread;
+    std::atomic<bool> simulationRunning = false;
+    TripleBuffer<FrameSnapshot> frames;
+
+    // Counters and state hash from the last simulation frame, published by whichever thread runs it
+    std::mutex countersMutex;
+    PerfCounters publishedCounters;
+    std::atomic<uint64_t> publishedStateHash = 0;
+    double renderSeconds = 0.0;
+
+    Label* perfOverlay = nullptr;
+    bool showPerfOverlay = false;
+    double timeSinceOverlayUpdate = 0.0;
+
+    // Set while recording an input journal
+    std::unique_ptr<InputJournal::Writer> journal{};
+
+    // Config to show in the selection menu, handed from the simulation side to the main thread
+    std::mutex menuMutex;
+    std::optional<std::pair<Materials, Entities>> pendingMenuContents;
 
     void handleMouseInput(double delta);
 
+    void pushCommand(Command&& command);
+    void processCommands();
+    void apply(PaintCommand& command);
+    void apply(SpawnCommand& command);
+    void apply(ClearCommand& command);
+    void apply(LoadConfigCommand& command);
+    void apply(ImportDataCommand& command);
+    void apply(ExportDataCommand& command);
+    void apply(UndoCommand& command);
+    void apply(SpeedCommand& command);
+    void apply(RecoverAutosaveCommand& command);
+    void apply(RecordJournalCommand& command);
+    void apply(PrintBehaviorProfileCommand& command);
+    void apply(AutosavePathCommand& command);
+    void apply(WatchdogPathCommand& command);
+
+    // Runs one simulation step on the thread that owns gameState
+    void tick(double delta);
+    void updateAutosave(double delta);
+    void updateWatchdogBaseline(double delta, bool watching);
+    void captureSlowTick(double ms);
+    bool restoreAutosave();
+    void publishMenuContents();
+    void updatePerfOverlay(double delta);
+
+    // Handles --fast-forward, --replay and the benchmarks; returns whether the command line asked for anything
+    bool runCommandLine();
+
+    void startSimulationThread();
+    void stopSimulationThread();
+    void runSimulation(int ticksPerSecond);
+
 protected:
     static void _bind_methods();
 
@@ -37,6 +150,7 @@ public:
     void _ready() override;
     void _process(double p_delta) override;
     void _physics_process(double delta) override;
+    void _exit_tree() override;
 
     void setGridSize(Vector2i p_width);
     Vector2i getGridSize() const;
@@ -46,10 +160,67 @@ public:
     int getMaxUndoSaves() const;
     void setDefaultConfig(String p_file);
     String getDefaultConfig() const;
+    void setAutosaveEnabled(bool p_enabled);
+    bool isAutosaveEnabled() const;
+    void setAutosaveInterval(double p_interval);
+    double getAutosaveInterval() const;
+    void setAutosavePath(String p_path);
+    String getAutosavePath() const;
+    void setWatchdogEnabled(bool p_enabled);
+    bool isWatchdogEnabled() const;
+    void setWatchdogThreshold(double p_ms);
+    double getWatchdogThreshold() const;
+    void setWatchdogPath(String p_path);
+    String getWatchdogPath() const;
+    void setThreadedSimulation(bool p_threaded);
+    bool isThreadedSimulation() const;
+    void setSeed(int64_t p_seed);
+    int64_t getSeed() const;
+    void setStateHashing(bool p_enabled);
+    bool isStateHashing() const;
+    int64_t getStateHash() const;
+    void setProfileBehavior(bool p_enabled);
+    bool isProfilingBehavior() const;
+    void setSimulationThreads(int p_threads);
+    int getSimulationThreads() const;
+    // Prints every behavior tree with per-node invocations, outcomes and time, aggregated over all
+    // entities since profiling started or the last reset
+    void printBehaviorProfile(bool p_reset);
+    void setMaxCatchUpTicks(int p_ticks);
+    int getMaxCatchUpTicks() const;
+    void setFrameBudgetSplit(Vector3 p_split);
+    Vector3 getFrameBudgetSplit() const;
+
+    Dictionary getSchedulerStats() const;
+    Dictionary getPerfCounters();
+    // Writes the recorded trace zones as Chrome trace JSON (needs a `scons tracing=yes` build)
+    bool dumpTrace(String p_file);
+    void setShowPerfOverlay(bool p_show);
+    bool isShowingPerfOverlay() const;
 
     void exportData(String p_file);
     void importData(String p_file);
     void importConfig(String p_file, bool undoable);
+    void recoverAutosave();
+
+    // Loads a config and/or save, runs the given number of tile and entity ticks as fast as possible
+    // without rendering, and writes the resulting state (plus timings next to it). Returns the timings.
+    Dictionary fastForward(String p_config, String p_save, int p_ticks, String p_output);
+
+    // Records every change to the state from now on (see InputJournal)
+    void startJournal(String p_file);
+    void stopJournal();
+    // Replays a journal as fast as possible, optionally writing the final state. Returns timings.
+    Dictionary replayJournal(String p_file, String p_output);
+
+    // Runs the engine-side benchmarks against the default config and writes the results as JSON
+    void runBenchmarks(String p_file);
+    // Sweeps grid sizes up to p_max_size, fills, entity counts and the given thread counts (default 1)
+    // over the bundled configs, each also in MARGOLUS mode, and writes the results as CSV; see ScalingBenchmark
+    void runScalingBenchmark(String p_file, int p_max_size, PackedInt32Array p_threads);
+
+    // Loads a config into the current state right away; only call from the thread owning gameState
+    bool applyConfig(const String& file, bool undoable);
 
     void saveState();
     void speedChanged();
@@ -1,24 +1,26 @@
 #include "GameState.h"
 
+#include <bit>
+
 #include "BehaviorEntity.h"
-#include "MaterialSimulator.h"
+#include "core/MaterialSimulator.h"
+#include "Tracing.h"
 #include "BoidEntity.h"
 #include "GameManager.h"
 
-Entity* Entity::instantiateEntity(const StringName &type, Ref<EntityProperties> properties, Vector2 position) {
+Entity* Entity::instantiateEntity(const StringName &type, Ref<EntityProperties> properties, Vector2 position, Random& random) {
     switch (properties->type) {
         case EntityProperties::STATIC:
             return new Entity(type, properties, position);
         case EntityProperties::BOID:
-            return new BoidEntity(type, properties, position);
+            return new BoidEntity(type, properties, position, random);
         case EntityProperties::BEHAVIOR:
             return new BehaviorEntity(type, properties, position);
     }
 }
 
-void Entity::render(Ref<Image> image) {
-    Vector2i pos = position.round();
-    image->set_pixel(pos.x, pos.y, properties->color);
+void Entity::render(FrameSnapshot& frame) {
+    frame.sprites.push_back({position.round(), properties->color});
 }
 
 Pixel Entity::getCurrentTile(const GameState& gameState) const {
@@ -64,53 +66,185 @@ bool Entity::hasLineOfSightTo(GameState& gameState, Vector2 pos) {
 }
 
 GameState::GameState(GameManager* gameManager, Vector2i size, double tileSpeed, double entitySpeed)
-        : gameManager(gameManager), grid(size), tileSpeed(tileSpeed), entitySpeed(entitySpeed) {}
+        : gameManager(gameManager), grid(toVec2i(size)), tileSpeed(tileSpeed), entitySpeed(entitySpeed) {}
+
+void GameState::setConfig(String configFile, Materials materials, Entities entities) {
+    // Material IDs are specific to a config, so translate the existing tiles
+    std::vector<MaterialId> remap(this->materials.size());
+    for (size_t id = 0; id < remap.size(); ++id) {
+        remap[id] = materials.getId(this->materials.getName(id));
+    }
+    for (Pixel& p : grid.data) {
+        p.material = remap[p.material];
+    }
+    grid.wakeAll();
+
+    this->configFile = configFile;
+    this->materials = materials;
+    this->entities = entities;
+}
 
 void GameState::generateFrame(const Ref<Image>& image) {
-    // Write material colors
-    for (int x = 0; x < grid.size.x; ++x) {
-        for (int y = 0; y < grid.size.y; ++y) {
-            auto pixel = grid[x, y];
-            const Ref<MaterialProperties> properties = materials.getProperties(pixel.material);
-            Color color = properties->color;
+    captureFrame(frame);
+    frame.render(image);
+}
 
+void GameState::captureFrame(FrameSnapshot& frame) {
+    TRACE_ZONE("GameState::captureFrame");
+    frame.size = toVector2i(grid.size);
+    grid.copyRows(frame.tiles);
+
+    frame.shades.resize(materials.size() * FrameSnapshot::SHADES);
+    frame.positionShaded.resize(materials.size());
+    for (size_t id = 0; id < materials.size(); ++id) {
+        const Ref<MaterialProperties>& properties = materials.getProperties(id);
+        for (int offset = -Pixel::MAX_SHADE; offset <= Pixel::MAX_SHADE; ++offset) {
+            Color color = properties->color;
+            // Fluids aren't shaded
             if (!properties->isFluid()) {
-                if (pixel.colorOffset < 0) {
-                    color = color.darkened(static_cast<float>(pixel.colorOffset * 0.03));
+                if (offset < 0) {
+                    color = color.darkened(static_cast<float>(offset * 0.03));
                 } else {
-                    color = color.lightened(static_cast<float>(pixel.colorOffset * 0.03));
+                    color = color.lightened(static_cast<float>(offset * 0.03));
                 }
             }
+            frame.shades[id * FrameSnapshot::SHADES + offset + Pixel::MAX_SHADE] = color;
+        }
+        frame.positionShaded[id] = properties->positionShaded;
+    }
+
+    frame.sprites.clear();
+    for (auto& e : entityInstances) {
+        e->render(frame);
+    }
+}
+
+void FrameSnapshot::render(const Ref<Image>& image) const {
+    TRACE_ZONE("FrameSnapshot::render");
+    if (image->get_size() != size) {
+        image->resize(size.x, size.y);
+    }
 
-            image->set_pixel(x, y, color);
+    // Write material colors
+    for (int y = 0; y < size.y; ++y) {
+        for (int x = 0; x < size.x; ++x) {
+            const Pixel& pixel = tiles[y * size.x + x];
+            const int offset = positionShaded[pixel.material] ? Pixel::shadeAt(x, y, pixel.material) : pixel.colorOffset;
+            image->set_pixel(x, y, shades[pixel.material * SHADES + offset + Pixel::MAX_SHADE]);
         }
     }
 
     // Draw entities
-    for (auto& e : entityInstances) {
-        e->render(image);
+    for (const Sprite& sprite : sprites) {
+        image->set_pixel(sprite.position.x, sprite.position.y, sprite.color);
     }
 }
 
-void GameState::process(double delta) {
+int GameState::process(double delta, TickScheduler& scheduler) {
+    TRACE_ZONE("GameState::process");
+    Time* time = Time::get_singleton();
+    counters.reset();
+
     // Process tiles (based on simSpeed)
-    double timePerFrame = 1.0 / tileSpeed;
-    timeSinceLastFrame += delta;
-    while (timeSinceLastFrame > timePerFrame) {
-        MaterialSimulator::process(grid, materials);
-        timeSinceLastFrame -= timePerFrame;
+    int due = scheduler.schedule(delta, tileSpeed);
+    uint64_t start = time->get_ticks_usec();
+    double elapsed = 0.0;
+    int ticks = 0;
+    while (ticks < due) {
+        processTiles();
+        scheduler.tickDone();
+        ++ticks;
+
+        elapsed = (time->get_ticks_usec() - start) / 1e6;
+        if (!scheduler.withinBudget(TickScheduler::TILES, elapsed)) {
+            scheduler.drop(due - ticks);
+            break;
+        }
     }
+    scheduler.record(TickScheduler::TILES, elapsed);
+    counters.tileSeconds = elapsed;
 
     // Process entities
-    delta *= entitySpeed;
+    start = time->get_ticks_usec();
+    processEntities(delta * entitySpeed);
+    counters.entitySeconds = (time->get_ticks_usec() - start) / 1e6;
+    scheduler.record(TickScheduler::ENTITIES, counters.entitySeconds);
+    return ticks;
+}
+
+void GameState::step(int tileTicks, double delta) {
+    counters.reset();
+    for (int i = 0; i < tileTicks; ++i) {
+        processTiles();
+    }
+    processEntities(delta * entitySpeed);
+}
+
+void GameState::processTiles() {
+    TRACE_ZONE("MaterialSimulator::process");
+    int64_t moves = grid.moves;
+    if (materials.getTable().getMode() == MaterialTable::MARGOLUS) {
+        margolus.process(grid, materials.getTable(), simulationThreads);
+    } else {
+        MaterialSimulator::process(grid, materials.getTable(), random);
+    }
+    ++counters.tileTicks;
+    counters.tilesMoved += grid.moves - moves;
+    counters.activeChunks = grid.activeChunkCount;
+    if (hashing) {
+        updateHash();
+    }
+}
+
+void GameState::processEntities(double delta) {
+    TRACE_ZONE("GameState::processEntities");
+    entitiesChanged |= !entityInstances.empty();
+    for (Entity* e : entityInstances) {
+        ++counters.entityCounts[e->getType()];
+    }
     for (int i = 0; i < entityInstances.size(); ++i) {
+        TRACE_ZONE_DETAIL("Entity::process", entityInstances[i]->getProperties()->traceName);
         entityInstances[i]->process(delta, *this);
         if (entityInstances[i]->isDead()) {
+            ++counters.deadEntities;
             delete entityInstances[i];
             entityInstances.erase(entityInstances.begin() + i);
             --i;
         }
     }
+    if (hashing) {
+        updateHash();
+    }
+}
+
+void GameState::updateHash() {
+    StateHash hash(stateHash);
+    hash.add(grid);
+    for (Entity* e : entityInstances) {
+        hash.add(e->getType().hash());
+        hash.add(std::bit_cast<uint64_t>(static_cast<double>(e->getPosition().x)));
+        hash.add(std::bit_cast<uint64_t>(static_cast<double>(e->getPosition().y)));
+    }
+    stateHash = hash.get();
+}
+
+void GameState::loadConfig(const String& file) {
+    gameManager->applyConfig(file, false);
+}
+
+void GameState::paint(const StringName& material, const std::vector<Vector2i>& cells) {
+    // Validate once for the whole stroke rather than per tile
+    int id = materials.findId(material);
+    if (id == -1) {
+        UtilityFunctions::printerr("Invalid material type: ", material);
+        return;
+    }
+
+    for (const Vector2i& pos : cells) {
+        if (isInBounds(pos)) {
+            grid.set(pos.x, pos.y, makePixel(id));
+        }
+    }
 }
 
 void GameState::processNearbyEntities(Vector2 position, double radius, const std::function<void(Entity&)>& callback) {
@@ -123,16 +257,18 @@ void GameState::processNearbyEntities(Vector2 position, double radius, const std
 }
 
 Ref<JSON> GameState::exportData() {
+    TRACE_ZONE("GameState::exportData");
     Dictionary data;
 
     data["config"] = configFile;
-    data["size"] = UtilityFunctions::var_to_str(grid.size);
+    data["size"] = UtilityFunctions::var_to_str(getDimensions());
+    data["tick"] = grid.tick;
 
     Array gridData;
     gridData.resize(grid.size.x * grid.size.y);
     for (int y = 0; y < grid.size.y; ++y) {
         for (int x = 0; x < grid.size.x; ++x) {
-            gridData[y * grid.size.x + x] = grid[x, y].material;
+            gridData[y * grid.size.x + x] = materials.getName(grid.get(x, y).material);
         }
     }
     data["grid"] = gridData;
@@ -152,14 +288,18 @@ Ref<JSON> GameState::exportData() {
 }
 
 Vector2i GameState::importData(Ref<JSON> json) {
+    TRACE_ZONE("GameState::importData");
     Dictionary data = json->get_data();
 
     Vector2i size = UtilityFunctions::str_to_var(data.get_or_add("size", "Vector2i(50, 50)"));
     clearGrid({size.x, size.y});
 
+    // Right away rather than through the command queue: this already runs on the thread that owns
+    // the state, and the tiles below need the new config's materials
     if (data.has("config")) {
-        gameManager->importConfig(data["config"], false);
-    };
+        loadConfig(data["config"]);
+    }
+    grid.tick = data.get("tick", 0);
 
     Array gridData = data.get_or_add("grid", Array());
     for (int y = 0; y < grid.size.y; ++y) {
@@ -168,7 +308,7 @@ Vector2i GameState::importData(Ref<JSON> json) {
             if (i >= gridData.size()) {
                 break;
             }
-            grid[x, y] = Pixel{gridData[i]};
+            grid.set(x, y, makePixel(materials.getId(gridData[i])));
         }
     }
 
@@ -184,17 +324,118 @@ Vector2i GameState::importData(Ref<JSON> json) {
     return size;
 }
 
-std::unique_ptr<GameState> GameState::clone() {
-    std::unique_ptr<GameState> result = std::make_unique<GameState>(gameManager, grid.size, tileSpeed, entitySpeed);
+Dictionary GameState::saveSnapshot() const {
+    TRACE_ZONE("GameState::saveSnapshot");
+    Dictionary snapshot;
+    snapshot["config"] = configFile;
+    snapshot["size"] = getDimensions();
+    snapshot["tick"] = grid.tick;
+    snapshot["state_hash"] = static_cast<int64_t>(stateHash);
+
+    PackedStringArray names;
+    for (size_t id = 0; id < materials.size(); ++id) {
+        names.push_back(materials.getName(id));
+    }
+    snapshot["materials"] = names;
 
-    result->setConfig(configFile, materials, entities);
+    // Material ID in the low 16 bits and the color offset above them, row by row
+    PackedInt32Array tiles;
+    tiles.resize(grid.size.x * grid.size.y);
     for (int y = 0; y < grid.size.y; ++y) {
         for (int x = 0; x < grid.size.x; ++x) {
-            result->grid[x, y] = grid[x, y];
+            const Pixel& p = grid.get(x, y);
+            tiles[y * grid.size.x + x] = p.material | static_cast<int32_t>(p.colorOffset) << 16;
         }
     }
+    snapshot["tiles"] = tiles;
+
+    Array entityData;
+    for (const Entity* e : entityInstances) {
+        entityData.append(saveEntity(*e));
+    }
+    snapshot["entities"] = entityData;
+    return snapshot;
+}
+
+Dictionary GameState::saveEntity(const Entity& entity) {
+    Dictionary data;
+    data["type"] = entity.getType();
+    data["position"] = entity.getPosition();
+    entity.saveState(data);
+    return data;
+}
+
+bool GameState::restoreEntity(const Dictionary& data) {
+    StringName type = data.get("type", "");
+    Ref<EntityProperties> properties = entities.getProperties(type);
+    if (properties.is_null()) {
+        UtilityFunctions::printerr("Invalid entity type: ", type);
+        return false;
+    }
+
+    // The entity takes its state from data, so whatever it draws when created doesn't matter and
+    // comes from a generator of its own
+    Random unused;
+    Entity* e = Entity::instantiateEntity(type, properties, data.get("position", Vector2()), unused);
+    e->loadState(data);
+    entityInstances.push_back(e);
+    entitiesChanged = true;
+    return true;
+}
+
+void GameState::loadSnapshot(const Dictionary& snapshot) {
+    TRACE_ZONE("GameState::loadSnapshot");
+    Vector2i size = snapshot.get("size", Vector2i(50, 50));
+    clearGrid(size);
+    if (snapshot.has("config")) {
+        loadConfig(snapshot["config"]);
+    }
+    grid.tick = snapshot.get("tick", 0);
+    stateHash = static_cast<uint64_t>(static_cast<int64_t>(snapshot.get("state_hash", 0)));
+
+    PackedStringArray names = snapshot.get("materials", PackedStringArray());
+    std::vector<MaterialId> ids;
+    for (int i = 0; i < names.size(); ++i) {
+        ids.push_back(materials.getId(names[i]));
+    }
+
+    PackedInt32Array tiles = snapshot.get("tiles", PackedInt32Array());
+    for (int y = 0; y < grid.size.y; ++y) {
+        for (int x = 0; x < grid.size.x; ++x) {
+            int i = y * grid.size.x + x;
+            if (i >= tiles.size()) {
+                break;
+            }
+            int index = tiles[i] & 0xFFFF;
+            if (static_cast<size_t>(index) >= ids.size()) {
+                UtilityFunctions::printerr("Invalid material index in snapshot: ", index);
+                return;
+            }
+            Pixel p;
+            p.material = ids[index];
+            p.colorOffset = static_cast<char>(tiles[i] >> 16);
+            grid.set(x, y, p);
+        }
+    }
+
+    Array entityData = snapshot.get("entities", Array());
+    for (int i = 0; i < entityData.size(); ++i) {
+        restoreEntity(entityData[i]);
+    }
+    entitiesChanged = true;
+}
+
+std::unique_ptr<GameState> GameState::clone() {
+    std::unique_ptr<GameState> result = std::make_unique<GameState>(gameManager, getDimensions(), tileSpeed, entitySpeed);
+
+    result->setConfig(configFile, materials, entities);
+    result->random = random;
+    result->hashing = hashing;
+    result->stateHash = stateHash;
+    result->grid.tick = grid.tick;
+    result->grid.copyTiles(grid);
     for (auto* e : entityInstances) {
-        result->entityInstances.push_back(Entity::instantiateEntity(e->getType(), e->getProperties(), e->getPosition()));
+        result->entityInstances.push_back(e->clone());
     }
 
     return result;
@@ -7,76 +7,39 @@
 #include "Entities.h"
 #include "godot_includes.h"
 #include "Materials.h"
+#include "PerfCounters.h"
+#include "TickScheduler.h"
+#include "core/Grid.h"
+#include "core/MargolusSimulator.h"
+#include "core/StateHash.h"
 
 // Forward declaration
 class GameManager;
 
-struct Pixel {
-    StringName material{""};
-    char colorOffset{0};
+// Conversions between core and Godot types
+inline Vector2i toVector2i(const Vec2i v) { return {v.x, v.y}; }
+inline Vec2i toVec2i(const Vector2i v) { return {v.x, v.y}; }
 
-    explicit Pixel(StringName material)
-        : material(std::move(material)) {
-        // set to random color offset between -3 and 3
-        colorOffset = static_cast<char>(UtilityFunctions::randi_range(-3, 3));
-    }
-
-    explicit Pixel() = default;
-};
+// Everything needed to draw one frame, copied out of a GameState so it can be rendered
+// while the simulation keeps running
+struct FrameSnapshot {
+    struct Sprite {
+        Vector2i position;
+        Color color;
+    };
 
-struct Grid {
-    std::vector<Pixel> data;
-    std::vector<bool> updated;
     Vector2i size;
+    std::vector<Pixel> tiles;
 
-    Pixel& operator[](const int x, const int y) {
-        if(x < 0 || x >= size.x && y < 0 && y >= size.y) {
-            UtilityFunctions::printerr("Accessing invalid tile ", x, ", ", y);
-            DEV_ASSERT(false);
-        }
-        return data[y * size.x + x];
-    }
-
-    const Pixel& operator[](int x, int y) const {
-        DEV_ASSERT(x >= 0 && x < size.x && y >= 0 && y < size.y);
-        return data[y * size.x + x];
-    }
-
-    bool wasUpdated(const int x, const int y) {
-        return updated[y * size.x + x] && ((*this)[x,y]).material != StringName("");
-    }
-
-    void setUpdated(const int x, const int y) {
-        updated[y * size.x + x] = true;
-    }
-
-    void finalizeUpdate() {
-        for (auto && i : updated) {
-            i = false;
-        }
-    }
-
-    void swapTiles(const int x1, const int y1, const int x2, const int y2) {
-        DEV_ASSERT(x1 >= 0 && x1 < size.x && y1 >= 0 && y1 < size.y);
-        DEV_ASSERT(x2 >= 0 && x2 < size.x && y2 >= 0 && y2 < size.y);
-        auto temp = (*this)[x1, y1];
-        (*this)[x1, y1] = (*this)[x2, y2];
-        (*this)[x2, y2] = temp;
-        setUpdated(x1, y1);
-        setUpdated(x2, y2);
-    }
-
-    void reset(Vector2i sz) {
-        size = sz;
+    // Each material's color at every color offset, indexed by MaterialId * SHADES + offset + MAX_SHADE
+    static constexpr int SHADES = 2 * Pixel::MAX_SHADE + 1;
+    std::vector<Color> shades;
+    // Indexed by MaterialId
+    std::vector<uint8_t> positionShaded;
 
-        data.clear();
-        data.resize(size.x * size.y);
-
-        updated.clear();
-        updated.resize(size.x * size.y);
-    }
+    std::vector<Sprite> sprites;
 
-    explicit Grid(Vector2i size) : data(size.x * size.y), updated(size.x * size.y), size(size) {}
+    void render(const Ref<Image>& image) const;
 };
 
 class GameState;
@@ -93,12 +56,17 @@ protected:
 public:
     virtual ~Entity() = default;
 
-    static Entity* instantiateEntity(const StringName &type, Ref<EntityProperties> properties, Vector2 position);
+    static Entity* instantiateEntity(const StringName &type, Ref<EntityProperties> properties, Vector2 position, Random& random);
+    // A copy in exactly the same state, without drawing any random numbers
+    virtual Entity* clone() const { return new Entity(*this); }
+    // Whatever else the entity needs to continue exactly where it was, for GameState snapshots
+    virtual void saveState(Dictionary& data) const {}
+    virtual void loadState(const Dictionary& data) {}
 
-    virtual void render(Ref<Image> image);
+    virtual void render(FrameSnapshot& frame);
     virtual void process(double delta, GameState& gameState) {}
 
-    StringName getType() { return type; }
+    StringName getType() const { return type; }
     Vector2 getPosition() const { return position; }
     Ref<EntityProperties> getProperties() { return properties; }
     Pixel getCurrentTile(const GameState& gameState) const;
@@ -120,7 +88,30 @@ class GameState {
     std::vector<Entity*> entityInstances;
 
     double tileSpeed, entitySpeed;
-    double timeSinceLastFrame = 0.0;
+
+    // Scratch space for generateFrame
+    FrameSnapshot frame;
+
+    // Whether any entity spawned, died or moved since the last consumeEntitiesChanged()
+    bool entitiesChanged = true;
+
+    // All randomness in the simulation comes from here, so a run is reproducible from its seed
+    Random random;
+
+    // When enabled, folded with the grid and entities after every tile and entity tick
+    bool hashing = false;
+    uint64_t stateHash = 0;
+
+    // When enabled, every behavior node times itself and counts its outcomes (see BehaviorNode::Stats)
+    bool profilingBehavior = false;
+
+    // Worker threads for simulation modes that can split a tick (only MARGOLUS so far)
+    int simulationThreads = 1;
+    MargolusSimulator margolus;
+
+    void updateHash();
+
+    PerfCounters counters;
 
 public:
 
@@ -132,10 +123,43 @@ public:
         }
     }
 
-    void setConfig(String configFile, Materials materials, Entities entities) {
-        this->configFile = configFile;
-        this->materials = materials;
-        this->entities = entities;
+    void setConfig(String configFile, Materials materials, Entities entities);
+
+    void setSeed(uint64_t seed) {
+        random.seedWith(seed);
+    }
+
+    Random& getRandom() { return random; }
+    const Random& getRandom() const { return random; }
+    void setRandom(const Random& r) { random = r; }
+
+    void setHashing(bool enabled) {
+        hashing = enabled;
+    }
+
+    bool isHashing() const { return hashing; }
+
+    uint64_t getStateHash() const { return stateHash; }
+
+    void setProfilingBehavior(bool enabled) {
+        profilingBehavior = enabled;
+    }
+
+    bool isProfilingBehavior() const { return profilingBehavior; }
+
+    void setSimulationThreads(int threads) {
+        simulationThreads = threads;
+    }
+
+    PerfCounters& getCounters() { return counters; }
+
+    Pixel makePixel(MaterialId material) {
+        Pixel pixel{material, materials.getTable()[material], random};
+        // Air is left unshaded so empty chunks stay uniform, which tiled grids store only once
+        if (material == MaterialTable::AIR) {
+            pixel.colorOffset = 0;
+        }
+        return pixel;
     }
 
     void setSimSpeed(double tileSpeed, double entitySpeed) {
@@ -144,8 +168,15 @@ public:
     }
 
     void generateFrame(const Ref<Image>& image);
+    void captureFrame(FrameSnapshot& frame);
 
-    void process(double delta);
+    // Returns how many tile ticks ran
+    int process(double delta, TickScheduler& scheduler);
+    // Runs a frame exactly as process did, given how many tile ticks it ran
+    void step(int tileTicks, double delta);
+    // A single tile tick, and a single entity update of the given (already scaled) length
+    void processTiles();
+    void processEntities(double delta);
 
     // TODO: change to generator?
     // Could maybe be parallelized?
@@ -157,11 +188,15 @@ public:
         return result;
     }
 
-    Ref<MaterialProperties> getMaterialProperties(const Pixel& p) {
+    const Ref<MaterialProperties>& getMaterialProperties(const Pixel& p) const {
         return materials.getProperties(p.material);
     }
 
-    Vector2i getDimensions() const { return grid.size; }
+    const StringName& getMaterialName(const Pixel& p) const {
+        return materials.getName(p.material);
+    }
+
+    Vector2i getDimensions() const { return toVector2i(grid.size); }
 
     [[nodiscard]] bool isInBounds(const Vector2i pos) const {
         return pos.x >= 0 && pos.x < grid.size.x && pos.y >= 0 && pos.y < grid.size.y;
@@ -172,20 +207,21 @@ public:
             return grid[pos.x, pos.y];
         }
         // UtilityFunctions::printerr("Accessing invalid tile ", pos.x, ", ", pos.y);
-        return Pixel{""};
+        return Pixel{};
     }
 
     void setTile(Vector2i pos, const Pixel& p) {
-        StringName type = p.material;
         if (isInBounds(pos)) {
-            if (materials.getProperties(type).is_null()) {
-                UtilityFunctions::printerr("Invalid mateiral type: ", type);
+            if (p.material >= materials.size()) {
+                UtilityFunctions::printerr("Invalid material id: ", p.material);
                 return;
             }
-            grid[pos.x, pos.y] = p;
+            grid.set(pos.x, pos.y, p);
         }
     }
 
+    void paint(const StringName& material, const std::vector<Vector2i>& cells);
+
     void spawnEntity(const Vector2i pos, const StringName& type) {
         if (isInBounds(pos)) {
             const auto properties = entities.getProperties(type);
@@ -193,27 +229,56 @@ public:
                 UtilityFunctions::printerr("Invalid entity type: ", type);
                 return;
             }
-            entityInstances.push_back(Entity::instantiateEntity(type, properties, pos));
+            entityInstances.push_back(Entity::instantiateEntity(type, properties, pos, random));
+            entitiesChanged = true;
         }
     }
 
-    void clearGrid(Vector2i size = {-1, -1}) {
-        if (size == Vector2i(-1, -1)) {
-            size = grid.size;
-        }
-        grid.reset(size);
+    void clearEntities() {
         for (auto* e : entityInstances) {
             delete e;
         }
         entityInstances.clear();
+        entitiesChanged = true;
+    }
+
+    void clearGrid(Vector2i size = {-1, -1}) {
+        if (size == Vector2i(-1, -1)) {
+            size = getDimensions();
+        }
+        grid.reset(toVec2i(size));
+        clearEntities();
     }
 
+    void loadConfig(const String& file);
+
     Materials& getMaterials() { return materials; }
     Entities& getEntities() { return entities; }
+    const String& getConfigFile() const { return configFile; }
+
+    Grid& getGrid() { return grid; }
+    const std::vector<Entity*>& getEntityInstances() const { return entityInstances; }
+
+    bool consumeEntitiesChanged() {
+        bool changed = entitiesChanged;
+        entitiesChanged = false;
+        return changed;
+    }
 
     Ref<JSON> exportData();
     Vector2i importData(Ref<JSON> data);
 
+    // Everything the simulation depends on, exactly (color offsets, entity positions and state, the
+    // tick and the rolling hash), where exportData keeps only what a save needs. The random state
+    // isn't included; input journals store it next to the snapshot.
+    Dictionary saveSnapshot() const;
+    void loadSnapshot(const Dictionary& snapshot);
+
+    // One entity as snapshots store it: its type, exact position and Entity::saveState
+    static Dictionary saveEntity(const Entity& entity);
+    // Adds an entity stored by saveEntity. Returns false if its type isn't in the config.
+    bool restoreEntity(const Dictionary& data);
+
     std::unique_ptr<GameState> clone();
 };
 
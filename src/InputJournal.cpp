@@ -0,0 +1,165 @@
+#include "InputJournal.h"
+
+bool InputJournal::Writer::open(const String& path, const GameState& state) {
+    file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("Failed to open input journal: ", path);
+        return false;
+    }
+
+    file->store_32(MAGIC);
+    file->store_32(VERSION);
+    file->store_64(state.getRandom().getState());
+    file->store_64(state.getRandom().getIncrement());
+    hashed = state.isHashing();
+    file->store_8(hashed);
+    file->store_var(state.saveSnapshot());
+    frame = 0;
+    return true;
+}
+
+void InputJournal::Writer::record(const Command& command) {
+    std::visit([this](const auto& c) { write(c); }, command);
+}
+
+void InputJournal::Writer::endFrame(int tileTicks, double delta, uint64_t stateHash) {
+    file->store_8(FRAME);
+    file->store_16(tileTicks);
+    file->store_double(delta);
+    file->store_64(stateHash);
+    ++frame;
+}
+
+void InputJournal::Writer::write(const PaintCommand& command) {
+    file->store_8(PAINT);
+    file->store_32(frame);
+    file->store_pascal_string(command.material);
+    file->store_8(command.beginsStroke);
+    file->store_32(command.cells.size());
+    for (const Vector2i& cell : command.cells) {
+        file->store_16(static_cast<int16_t>(cell.x));
+        file->store_16(static_cast<int16_t>(cell.y));
+    }
+}
+
+void InputJournal::Writer::write(const SpawnCommand& command) {
+    file->store_8(SPAWN);
+    file->store_32(frame);
+    file->store_pascal_string(command.type);
+    file->store_32(command.position.x);
+    file->store_32(command.position.y);
+}
+
+void InputJournal::Writer::write(const ClearCommand& command) {
+    file->store_8(CLEAR);
+    file->store_32(frame);
+}
+
+void InputJournal::Writer::write(const LoadConfigCommand& command) {
+    file->store_8(LOAD_CONFIG);
+    file->store_32(frame);
+    file->store_pascal_string(command.file);
+    file->store_8(command.undoable);
+}
+
+void InputJournal::Writer::write(const ImportDataCommand& command) {
+    file->store_8(IMPORT_DATA);
+    file->store_32(frame);
+    file->store_pascal_string(JSON::stringify(command.data->get_data()));
+}
+
+void InputJournal::Writer::write(const UndoCommand& command) {
+    file->store_8(UNDO);
+    file->store_32(frame);
+}
+
+void InputJournal::Writer::write(const SpeedCommand& command) {
+    file->store_8(SPEED);
+    file->store_32(frame);
+    file->store_double(command.tileSpeed);
+    file->store_double(command.entitySpeed);
+}
+
+bool InputJournal::Reader::open(const String& path) {
+    file = FileAccess::open(path, FileAccess::READ);
+    if (file.is_null() || file->get_32() != MAGIC || file->get_32() != VERSION) {
+        UtilityFunctions::printerr("Invalid input journal: ", path);
+        return false;
+    }
+
+    uint64_t randomState = file->get_64();
+    random.restore(randomState, file->get_64());
+    hashed = file->get_8();
+    Variant data = file->get_var();
+    if (data.get_type() != Variant::DICTIONARY) {
+        UtilityFunctions::printerr("Invalid input journal: ", path);
+        return false;
+    }
+    snapshot = data;
+    return true;
+}
+
+std::optional<InputJournal::Record> InputJournal::Reader::next() {
+    if (file->eof_reached() || file->get_position() >= file->get_length()) {
+        return std::nullopt;
+    }
+
+    uint8_t type = file->get_8();
+    if (type == FRAME) {
+        Frame frame;
+        frame.tileTicks = file->get_16();
+        frame.delta = file->get_double();
+        frame.stateHash = file->get_64();
+        return frame;
+    }
+
+    // The frame number is implied by the FRAME records around it
+    file->get_32();
+    switch (type) {
+        case PAINT: {
+            PaintCommand command;
+            command.material = file->get_pascal_string();
+            command.beginsStroke = file->get_8();
+            uint32_t count = file->get_32();
+            command.cells.reserve(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                int x = static_cast<int16_t>(file->get_16());
+                int y = static_cast<int16_t>(file->get_16());
+                command.cells.emplace_back(x, y);
+            }
+            return command;
+        }
+        case SPAWN: {
+            SpawnCommand command;
+            command.type = file->get_pascal_string();
+            command.position.x = static_cast<int32_t>(file->get_32());
+            command.position.y = static_cast<int32_t>(file->get_32());
+            return command;
+        }
+        case CLEAR:
+            return ClearCommand{};
+        case LOAD_CONFIG: {
+            LoadConfigCommand command;
+            command.file = file->get_pascal_string();
+            command.undoable = file->get_8();
+            return command;
+        }
+        case IMPORT_DATA: {
+            ImportDataCommand command;
+            command.data.instantiate();
+            command.data->parse(file->get_pascal_string());
+            return command;
+        }
+        case UNDO:
+            return UndoCommand{};
+        case SPEED: {
+            SpeedCommand command;
+            command.tileSpeed = file->get_double();
+            command.entitySpeed = file->get_double();
+            return command;
+        }
+        default:
+            UtilityFunctions::printerr("Corrupt input journal: ", file->get_path());
+            return std::nullopt;
+    }
+}
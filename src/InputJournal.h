@@ -0,0 +1,83 @@
+#ifndef INPUTJOURNAL_H
+#define INPUTJOURNAL_H
+
+#include <optional>
+#include <variant>
+
+#include "godot_includes.h"
+#include "Commands.h"
+#include "GameState.h"
+
+// A recorded session: an exact snapshot of the state (see GameState::saveSnapshot) and the state of
+// its random generator, then every command that changed the state (stamped with the frame it was applied
+// on) and how many tile ticks each frame ran. Replaying it reproduces the recorded run, so real
+// sessions can serve as benchmarks. Journals recorded with state hashing on also store the hash
+// after every frame, so a replay can tell where it stopped matching.
+//
+// Exports don't change the state and recovering an autosave depends on files outside the
+// journal, so neither is recorded.
+struct InputJournal {
+    static constexpr uint32_t MAGIC = 0x4A494246; // "FBIJ"
+    static constexpr uint32_t VERSION = 3;
+
+    enum RecordType : uint8_t {
+        FRAME = 'F',       // tile ticks run, the frame's delta and the state hash after it
+        PAINT = 'P',
+        SPAWN = 'S',
+        CLEAR = 'C',
+        LOAD_CONFIG = 'L',
+        IMPORT_DATA = 'I',
+        UNDO = 'U',
+        SPEED = 'V',
+    };
+
+    struct Frame {
+        int tileTicks = 0;
+        double delta = 0.0;
+        // After the frame; only meaningful in hashed journals
+        uint64_t stateHash = 0;
+    };
+
+    using Record = std::variant<Command, Frame>;
+
+    class Writer {
+        Ref<FileAccess> file;
+        uint32_t frame = 0;
+        bool hashed = false;
+
+        void write(const PaintCommand& command);
+        void write(const SpawnCommand& command);
+        void write(const ClearCommand& command);
+        void write(const LoadConfigCommand& command);
+        void write(const ImportDataCommand& command);
+        void write(const UndoCommand& command);
+        void write(const SpeedCommand& command);
+        void write(const auto& command) {}
+
+    public:
+        // Starts the journal from the given state, random generator included, so recording doesn't
+        // disturb the run. The journal is hashed if the state is; keep hashing on until it is closed.
+        bool open(const String& path, const GameState& state);
+
+        [[nodiscard]] bool isHashed() const { return hashed; }
+
+        void record(const Command& command);
+        void endFrame(int tileTicks, double delta, uint64_t stateHash);
+    };
+
+    class Reader {
+        Ref<FileAccess> file;
+
+    public:
+        Random random;
+        bool hashed = false;
+        Dictionary snapshot;
+
+        bool open(const String& path);
+        // Returns nothing at the end of the journal
+        std::optional<Record> next();
+    };
+};
+
+
+#endif //INPUTJOURNAL_H
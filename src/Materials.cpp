@@ -1,7 +1,40 @@
 #include "Materials.h"
 
+namespace {
+    // Returns -1 for unknown names
+    int directionFromString(const String& str) {
+        static const char* names[MaterialRules::DIRECTION_COUNT] = {"below", "below_left", "below_right", "left", "right"};
+        for (int d = 0; d < MaterialRules::DIRECTION_COUNT; ++d) {
+            if (str == names[d]) {
+                return d;
+            }
+        }
+        return -1;
+    }
+
+    // Returns -1 for unknown names
+    int classFromString(const String& str) {
+        static const char* names[MaterialRules::CLASS_COUNT] = {"EMPTY", "FLUID", "SOLID", "BLOCKED"};
+        for (int c = 0; c < MaterialRules::CLASS_COUNT; ++c) {
+            if (str == names[c]) {
+                return c;
+            }
+        }
+        return -1;
+    }
+
+    // What Materials::save writes for each material besides the table
+    struct SavedMaterial {
+        String name;
+        bool missing = false;
+        Color color;
+        String displayName;
+    };
+}
+
 Materials::Materials(Dictionary materials) {
     properties[""]      = {memnew(MaterialProperties)};
+    registerMaterial("", properties[""]);
 
     missingMaterial = Ref<MaterialProperties>{memnew(MaterialProperties)};
     missingMaterial->color = Color("#000000");
@@ -20,5 +53,165 @@ Materials::Materials(Dictionary materials) {
         props->color.a = mat.get_or_add("alpha", 1.0);
         props->type = MaterialProperties::typeFromString(mat.get_or_add("type", "STATIC"));
         props->name = mat.get_or_add("name", id.capitalize());
+        if (mat.has("density")) {
+            props->density = static_cast<float>(mat["density"]);
+        }
+        props->dispersion = Math::clamp(static_cast<int>(mat.get_or_add("dispersion", 1)), 1, MaterialRules::MAX_FLOW_DISTANCE);
+        props->updateInterval = Math::max(static_cast<int>(mat.get_or_add("updateInterval", 1)), 1);
+        props->steps = Math::max(static_cast<int>(mat.get_or_add("stepsPerTick", 1)), 1);
+        String shading = mat.get_or_add("shading", "RANDOM");
+        if (shading == "POSITION" && props->type != MaterialProperties::STATIC) {
+            // A moving tile would take the shade of every tile it passes, like a texture sliding under it
+            UtilityFunctions::printerr("\"shading\": \"POSITION\" is only for STATIC materials; using RANDOM for ", id);
+        } else if (shading != "POSITION" && shading != "RANDOM") {
+            UtilityFunctions::printerr("Unknown shading for material ", id, ": ", shading);
+        }
+        props->positionShaded = shading == "POSITION" && props->type == MaterialProperties::STATIC;
+        registerMaterial(id, props);
+    }
+
+    // Rules can turn materials into each other, so they're parsed once every material has an id
+    for (int i = 0; i < ids.size(); ++i) {
+        String id = ids[i];
+        Dictionary mat = materials[id];
+        if (mat.has("rules")) {
+            info.setRules(this->ids[id], parseRules(id, mat["rules"]));
+        }
+    }
+}
+
+// Each rule is a Dictionary like
+//   {"when": {"below": ["EMPTY", "FLUID"]}, "move": "below"}
+//   {"when": {"left": "EMPTY", "right": "EMPTY"}, "move": ["left", "right"]}
+//   {"when": {"below": "FLUID"}, "become": "wetSand"}
+//   {"flow": 8}
+// where "when" maps directions to the class (or classes) the neighbor there must have, and
+// "move" with two directions picks one at random. The first rule that matches applies.
+std::vector<MaterialRules::Rule> Materials::parseRules(const String& material, const Array& rules) const {
+    std::vector<MaterialRules::Rule> result;
+    for (int i = 0; i < rules.size(); ++i) {
+        Dictionary data = rules[i];
+        MaterialRules::Rule rule;
+        bool valid = true;
+
+        Dictionary when = data.get("when", Dictionary());
+        Array directions = when.keys();
+        for (int j = 0; j < directions.size(); ++j) {
+            int d = directionFromString(directions[j]);
+            if (d < 0) {
+                valid = false;
+                continue;
+            }
+            Array classes = when[directions[j]].get_type() == Variant::ARRAY ? Array(when[directions[j]]) : Array::make(when[directions[j]]);
+            rule.when[d] = 0;
+            for (int k = 0; k < classes.size(); ++k) {
+                int c = classFromString(classes[k]);
+                valid &= c >= 0;
+                rule.when[d] |= c >= 0 ? 1u << c : 0;
+            }
+        }
+
+        if (data.has("move")) {
+            Array moves = data["move"].get_type() == Variant::ARRAY ? Array(data["move"]) : Array::make(data["move"]);
+            int direction = moves.size() > 0 ? directionFromString(moves[0]) : -1;
+            int other = moves.size() > 1 ? directionFromString(moves[1]) : direction;
+            valid &= direction >= 0 && other >= 0 && moves.size() <= 2;
+            rule.action.kind = moves.size() == 2 ? MaterialRules::Action::MOVE_EITHER : MaterialRules::Action::MOVE;
+            rule.action.direction = static_cast<MaterialRules::Direction>(direction);
+            rule.action.other = static_cast<MaterialRules::Direction>(other);
+        } else if (data.has("become")) {
+            int target = findId(data["become"]);
+            valid &= target >= 0;
+            rule.action.kind = MaterialRules::Action::BECOME;
+            rule.action.material = target;
+        } else if (data.has("flow")) {
+            int distance = data["flow"];
+            valid &= distance >= 1 && distance <= MaterialRules::MAX_FLOW_DISTANCE;
+            rule.action.kind = MaterialRules::Action::FLOW;
+            rule.action.distance = distance;
+        }
+
+        if (!valid) {
+            UtilityFunctions::printerr("Invalid rule for material ", material, ": ", JSON::stringify(data));
+            continue;
+        }
+        result.push_back(rule);
+    }
+    return result;
+}
+
+void Materials::save(StreamPeerBuffer& out) const {
+    out.put_u32(table.size());
+    for (MaterialId id = 0; id < table.size(); ++id) {
+        out.put_utf8_string(names[id]);
+        out.put_u8(table[id] == missingMaterial);
+        out.put_var(table[id]->color);
+        out.put_utf8_string(table[id]->name);
+    }
+
+    std::vector<uint8_t> compiled = info.serialize();
+    PackedByteArray bytes;
+    bytes.resize(compiled.size());
+    std::copy(compiled.begin(), compiled.end(), bytes.ptrw());
+    out.put_var(bytes);
+}
+
+std::optional<Materials> Materials::load(StreamPeerBuffer& in) {
+    Materials result;
+    uint32_t count = in.get_u32();
+    // Settings the simulation uses come from the table, the rest from here
+    std::vector<SavedMaterial> entries;
+    for (uint32_t i = 0; i < count && in.get_available_bytes() > 0; ++i) {
+        SavedMaterial& entry = entries.emplace_back();
+        entry.name = in.get_utf8_string();
+        entry.missing = in.get_u8();
+        entry.color = in.get_var();
+        entry.displayName = in.get_utf8_string();
+    }
+
+    PackedByteArray bytes = in.get_var();
+    MaterialTable compiled;
+    if (entries.size() != count || count == 0 || !compiled.deserialize(bytes.ptr(), bytes.size()) || compiled.size() != count) {
+        return std::nullopt;
+    }
+
+    // The constructor already registered air as id 0
+    for (MaterialId id = 1; id < count; ++id) {
+        const SavedMaterial& entry = entries[id];
+        Ref<MaterialProperties> props = result.missingMaterial;
+        if (!entry.missing) {
+            const MaterialInfo& material = compiled[id];
+            props = Ref<MaterialProperties>{memnew(MaterialProperties)};
+            props->color = entry.color;
+            props->name = entry.displayName;
+            props->type = material.type;
+            props->density = material.density;
+            props->dispersion = material.dispersion;
+            props->updateInterval = material.updateInterval;
+            props->steps = material.steps;
+            props->positionShaded = material.positionShaded;
+            result.properties[entry.name] = props;
+        }
+        result.table.push_back(props);
+        result.names.push_back(entry.name);
+        result.ids.insert(entry.name, id);
+    }
+    result.info = std::move(compiled);
+    return result;
+}
+
+MaterialId Materials::registerMaterial(const StringName& name, const Ref<MaterialProperties>& props) {
+    MaterialId id = table.size();
+    table.push_back(props);
+    info.add(props->getInfo());
+    names.push_back(name);
+    ids.insert(name, id);
+    return id;
+}
+
+MaterialId Materials::getId(const StringName& name) {
+    if (const MaterialId* id = ids.getptr(name)) {
+        return *id;
     }
+    return registerMaterial(name, missingMaterial);
 }
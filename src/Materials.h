@@ -2,17 +2,15 @@
 #define MATERIALS_H
 
 #include "godot_includes.h"
+#include "core/MaterialTable.h"
 
 struct MaterialProperties : public Resource {
     Color color = Color{"#000000", 0.0};
     String name = "Air";
 
-    enum MaterialType : uint8_t {
-        EMPTY,
-        STATIC,
-        GRAVITY,
-        FLUID
-    } type = EMPTY;
+    using MaterialType = MaterialInfo::Type;
+    using enum MaterialInfo::Type;
+    MaterialType type = EMPTY;
 
     static MaterialType typeFromString(const String& str) {
         if (str == "STATIC") {
@@ -26,17 +24,26 @@ struct MaterialProperties : public Resource {
         }
     }
 
-    // Could add density or something
+    // Unset means the type's default, see MaterialInfo
+    std::optional<float> density;
+    int dispersion = 1;
+    int updateInterval = 1;
+    int steps = 1;
+    bool positionShaded = false;
 
     MaterialProperties() = default;
     MaterialProperties(Color color, MaterialType type) : color(color), type(type) {}
 
+    [[nodiscard]] MaterialInfo getInfo() const {
+        return MaterialInfo{type, density, dispersion, updateInterval, steps, positionShaded};
+    }
+
     [[nodiscard]] bool isFluid() const {
-        return type == FLUID;
+        return getInfo().isFluid();
     }
 
     [[nodiscard]] bool isSolid() const {
-        return type == STATIC || type == GRAVITY;
+        return getInfo().isSolid();
     }
 };
 
@@ -45,10 +52,36 @@ class Materials {
     Dictionary properties;
     Ref<MaterialProperties> missingMaterial;
 
+    // Lookup tables indexed by MaterialId; info is what the simulation core sees
+    MaterialTable info;
+    std::vector<Ref<MaterialProperties>> table;
+    std::vector<StringName> names;
+    HashMap<StringName, MaterialId> ids;
+
+    MaterialId registerMaterial(const StringName& name, const Ref<MaterialProperties>& props);
+    // Parses a material's "rules" from the config; see MaterialRules
+    std::vector<MaterialRules::Rule> parseRules(const String& material, const Array& rules) const;
+
 public:
+    static constexpr MaterialId AIR = MaterialTable::AIR;
+
     Materials() : Materials(Dictionary()) {}
     explicit Materials(Dictionary materials);
 
+    // Writes the built materials, compiled table included, for ConfigCache
+    void save(StreamPeerBuffer& out) const;
+    // Rebuilds materials written by save() without parsing or compiling anything. Returns nothing
+    // if the data is invalid or from another build.
+    static std::optional<Materials> load(StreamPeerBuffer& in);
+
+    static MaterialTable::Mode modeFromString(const String& str) {
+        return str == "MARGOLUS" ? MaterialTable::MARGOLUS : MaterialTable::SEQUENTIAL;
+    }
+
+    void setMode(MaterialTable::Mode mode) {
+        info.setMode(mode);
+    }
+
     [[nodiscard]] Array getAllMaterials() const {
         return properties.keys();
     }
@@ -57,6 +90,31 @@ public:
         Ref<MaterialProperties> props = properties[mat];
         return props.is_valid() ? props : missingMaterial;
     }
+
+    [[nodiscard]] const Ref<MaterialProperties>& getProperties(const MaterialId id) const {
+        return table[id];
+    }
+
+    // Unknown names (e.g. from a save made with another config) get a MISSING entry so they keep their name
+    MaterialId getId(const StringName& name);
+
+    // Like getId, but returns -1 for unknown names
+    [[nodiscard]] int findId(const StringName& name) const {
+        const MaterialId* id = ids.getptr(name);
+        return id ? *id : -1;
+    }
+
+    [[nodiscard]] const StringName& getName(const MaterialId id) const {
+        return names[id];
+    }
+
+    [[nodiscard]] const MaterialTable& getTable() const {
+        return info;
+    }
+
+    [[nodiscard]] size_t size() const {
+        return table.size();
+    }
 };
 
 
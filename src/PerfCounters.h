@@ -0,0 +1,47 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include "godot_includes.h"
+
+// What the simulation did during its last frame. Filled in by GameState::process and shown by
+// GameManager::get_perf_counters and the performance overlay.
+struct PerfCounters {
+    double tileSeconds = 0.0;
+    double entitySeconds = 0.0;
+
+    int64_t tileTicks = 0;
+    int64_t tilesMoved = 0;
+    // Chunks in which anything moved or was painted during the last tile tick
+    int64_t activeChunks = 0;
+
+    int64_t behaviorNodes = 0;
+    int64_t deadEntities = 0;
+    HashMap<StringName, int64_t> entityCounts;
+
+    void reset() {
+        tileSeconds = entitySeconds = 0.0;
+        tileTicks = tilesMoved = behaviorNodes = deadEntities = 0;
+        entityCounts.clear();
+    }
+
+    [[nodiscard]] Dictionary toDictionary() const {
+        Dictionary result;
+        result["tile_ms"] = tileSeconds * 1e3;
+        result["entity_ms"] = entitySeconds * 1e3;
+        result["tile_ticks"] = tileTicks;
+        result["tiles_moved"] = tilesMoved;
+        result["active_chunks"] = activeChunks;
+        result["behavior_nodes"] = behaviorNodes;
+        result["dead_entities"] = deadEntities;
+
+        Dictionary entities;
+        for (const KeyValue<StringName, int64_t>& count : entityCounts) {
+            entities[count.key] = count.value;
+        }
+        result["entities"] = entities;
+        return result;
+    }
+};
+
+
+#endif //PERFCOUNTERS_H
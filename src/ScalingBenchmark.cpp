@@ -0,0 +1,172 @@
+#include "ScalingBenchmark.h"
+
+#include <chrono>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "GameState.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Keep sampling each point until at least this much time has been measured
+    constexpr double MIN_SECONDS = 1.0;
+    // Ticks run from each fresh fill, so sand and water are measured while still moving
+    constexpr int TICKS_PER_SAMPLE = 20;
+    // Grid size for the entity sweeps
+    constexpr int ENTITY_GRID_SIZE = 256;
+
+    double processPeakMemoryMb() {
+#if defined(__linux__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / 1024.0; // KiB
+#elif defined(__APPLE__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / (1024.0 * 1024.0); // bytes
+#else
+        return OS::get_singleton()->get_static_memory_peak_usage() / (1024.0 * 1024.0);
+#endif
+    }
+
+    // The first material of the given type, or AIR
+    MaterialId findMaterial(Materials& materials, MaterialProperties::MaterialType type) {
+        Array names = materials.getAllMaterials();
+        for (int i = 0; i < names.size(); ++i) {
+            StringName name = names[i];
+            if (materials.getProperties(name)->type == type) {
+                return materials.getId(name);
+            }
+        }
+        return MaterialTable::AIR;
+    }
+
+    // The first entity of the given type, or an empty name
+    StringName findEntity(Entities& entities, EntityProperties::EntityType type) {
+        Array types = entities.getAllEntities();
+        for (int i = 0; i < types.size(); ++i) {
+            StringName name = types[i];
+            if (entities.getProperties(name)->type == type) {
+                return name;
+            }
+        }
+        return {};
+    }
+}
+
+void ScalingBenchmark::measure(const Config& config, const Point& point) {
+    Materials materials = config.materials;
+    Entities entities = config.entities;
+    MaterialId sand = findMaterial(materials, MaterialProperties::GRAVITY);
+    MaterialId water = findMaterial(materials, MaterialProperties::FLUID);
+    StringName boid = findEntity(entities, EntityProperties::BOID);
+    StringName behavior = findEntity(entities, EntityProperties::BEHAVIOR);
+    bool margolus = materials.getTable().getMode() == MaterialTable::MARGOLUS;
+
+    GameState state(nullptr, {point.size, point.size}, 0.0, 1.0);
+    state.setConfig(config.file, materials, entities);
+    state.setSeed(point.size);
+    state.setSimulationThreads(point.threads);
+
+    int64_t ticks = 0;
+    int64_t entityTicks = 0;
+    double tileSeconds = 0.0;
+    double entitySeconds = 0.0;
+    while (tileSeconds + entitySeconds < MIN_SECONDS) {
+        Grid& grid = state.getGrid();
+        Random& random = state.getRandom();
+        for (int y = 0; y < point.size; ++y) {
+            for (int x = 0; x < point.size; ++x) {
+                double roll = random.uniform();
+                MaterialId material = roll < point.sand ? sand : roll < point.sand + point.water ? water : MaterialTable::AIR;
+                grid[x, y] = state.makePixel(material);
+            }
+        }
+        grid.markAllDirty();
+
+        state.clearEntities();
+        for (int i = 0; i < point.boids; ++i) {
+            state.spawnEntity({random.range(0, point.size - 1), random.range(0, point.size - 1)}, boid);
+        }
+        for (int i = 0; i < point.behaviors; ++i) {
+            state.spawnEntity({random.range(0, point.size - 1), random.range(0, point.size - 1)}, behavior);
+        }
+
+        for (int i = 0; i < TICKS_PER_SAMPLE; ++i) {
+            auto start = Clock::now();
+            state.processTiles();
+            auto tilesDone = Clock::now();
+            entityTicks += state.getEntityInstances().size();
+            state.processEntities(1.0 / 60.0);
+            auto entitiesDone = Clock::now();
+
+            tileSeconds += std::chrono::duration<double>(tilesDone - start).count();
+            entitySeconds += std::chrono::duration<double>(entitiesDone - tilesDone).count();
+        }
+        ticks += TICKS_PER_SAMPLE;
+    }
+
+    double cells = static_cast<double>(point.size) * point.size;
+    double ticksPerSecond = ticks / (tileSeconds + entitySeconds);
+    double nsPerCell = tileSeconds * 1e9 / (ticks * cells);
+    double nsPerEntity = entityTicks > 0 ? entitySeconds * 1e9 / entityTicks : 0.0;
+    double gridMemory = state.getGrid().getMemoryUsage() / (1024.0 * 1024.0);
+    double peak = processPeakMemoryMb();
+    String mode = margolus ? "MARGOLUS" : "SEQUENTIAL";
+
+    csv->store_line(String("{0},{1},{2},{3},{4},{5},{6},{7},{8},{9},{10},{11},{12},{13}").format(Array::make(
+        config.file.get_file(), mode, point.size, point.sand, point.water, point.boids, point.behaviors, point.threads, ticks,
+        String::num(ticksPerSecond, 2), String::num(nsPerCell, 3), String::num(nsPerEntity, 1), String::num(gridMemory, 1),
+        String::num(peak, 1))));
+    csv->flush();
+
+    UtilityFunctions::print(String("{0} {1} {2}x{2} sand={3} water={4} boids={5} behaviors={6} threads={7}: {8} ticks/s, {9} ns/cell, {10} ns/entity, {11} MB grid").format(
+        Array::make(config.file.get_file(), mode, point.size, point.sand, point.water, point.boids, point.behaviors, point.threads,
+                    ticksPerSecond, nsPerCell, nsPerEntity, gridMemory)));
+}
+
+bool ScalingBenchmark::run(const String& file) {
+    csv = FileAccess::open(file, FileAccess::WRITE);
+    if (csv.is_null()) {
+        UtilityFunctions::printerr("Failed to save benchmark results to file: ", file);
+        return false;
+    }
+    csv->store_line("config,mode,grid_size,sand,water,boids,behaviors,threads,ticks,ticks_per_second,ns_per_cell,ns_per_entity,grid_memory_mb,process_peak_memory_mb");
+
+    struct Fill {
+        double sand, water;
+    };
+    const Fill fills[] = {{0.3, 0.0}, {0.0, 0.5}, {0.2, 0.4}};
+
+    for (int threads : threadCounts) {
+        for (Config& config : configs) {
+            // Only MARGOLUS splits the tiles across threads; entities always run on one
+            if (threads != 1 && config.materials.getTable().getMode() != MaterialTable::MARGOLUS) {
+                continue;
+            }
+
+            for (int size : sizes) {
+                for (const Fill& fill : fills) {
+                    measure(config, {size, fill.sand, fill.water, 0, 0, threads});
+                }
+            }
+
+            if (!findEntity(config.entities, EntityProperties::BOID).is_empty()) {
+                for (int count : entityCounts) {
+                    measure(config, {ENTITY_GRID_SIZE, 0.0, 0.5, count, 0, threads});
+                }
+            }
+            if (!findEntity(config.entities, EntityProperties::BEHAVIOR).is_empty()) {
+                for (int count : entityCounts) {
+                    measure(config, {ENTITY_GRID_SIZE, 0.0, 0.5, 0, count, threads});
+                }
+            }
+        }
+    }
+
+    csv.unref();
+    return true;
+}
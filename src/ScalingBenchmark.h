@@ -0,0 +1,51 @@
+#ifndef SCALINGBENCHMARK_H
+#define SCALINGBENCHMARK_H
+
+#include <vector>
+
+#include "godot_includes.h"
+#include "Materials.h"
+#include "Entities.h"
+
+// Sweeps the whole simulation over grid sizes, sand/water fill ratios, boid and behavior entity
+// counts and worker thread counts, for each of the given configs. Used to size hardware for
+// installations and to check that new simulation modes actually scale.
+//
+// Writes one CSV row per combination:
+//   config,mode,grid_size,sand,water,boids,behaviors,threads,ticks,ticks_per_second,ns_per_cell,ns_per_entity,grid_memory_mb,process_peak_memory_mb
+// grid_memory_mb is what the point's grid holds. process_peak_memory_mb is the high-water mark of
+// the whole process so far, so it only grows over a run and says little about any single point.
+// Thread counts other than 1 are only run for MARGOLUS configs, the only mode that splits ticks.
+class ScalingBenchmark {
+public:
+    struct Config {
+        String file;
+        Materials materials;
+        Entities entities;
+    };
+
+    std::vector<int> sizes{64, 128, 256, 512, 1024, 2048, 4096};
+    std::vector<int> entityCounts{100, 1000, 5000};
+    std::vector<int> threadCounts{1};
+
+private:
+    struct Point {
+        int size;
+        double sand, water;
+        int boids, behaviors;
+        int threads;
+    };
+
+    std::vector<Config> configs;
+    Ref<FileAccess> csv;
+
+    void measure(const Config& config, const Point& point);
+
+public:
+    explicit ScalingBenchmark(std::vector<Config> configs) : configs(std::move(configs)) {}
+
+    bool run(const String& file);
+};
+
+
+#endif //SCALINGBENCHMARK_H
@@ -0,0 +1,53 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+    std::vector<T> slots;
+    size_t mask;
+
+    // Kept on separate cache lines so the two threads don't false-share
+    alignas(64) std::atomic<size_t> head{0}; // Next slot to read; only advanced by the consumer
+    alignas(64) std::atomic<size_t> tail{0}; // Next slot to write; only advanced by the producer
+
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    // Returns false (and leaves value untouched) if the queue is full
+    bool push(T&& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty
+    bool pop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+
+#endif //SPSCRING_H
@@ -0,0 +1,89 @@
+#ifndef TICKSCHEDULER_H
+#define TICKSCHEDULER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Splits each frame's time budget between the tile simulation, the entity simulation and rendering,
+// and decides how many fixed-rate tile ticks to run. At most maxCatchUpTicks run per frame, and the
+// tile phase stops early once it has used its share of the budget. Whatever backlog is left over is
+// dropped, so an overloaded tank slows down instead of falling further and further behind.
+//
+// Settings and stats may be used from any thread; the rest only from the thread running the simulation.
+class TickScheduler {
+public:
+    enum Phase {
+        TILES,
+        ENTITIES,
+        RENDER,
+        PHASE_COUNT
+    };
+
+private:
+    double backlog = 0.0;
+    std::atomic<int> maxCatchUpTicks = 4;
+    std::atomic<double> frameBudget = 1.0 / 60.0;
+    std::atomic<double> budgetShare[PHASE_COUNT] = {0.5, 0.3, 0.2};
+
+    std::atomic<int64_t> ticks = 0;
+    std::atomic<int64_t> droppedTicks = 0;
+    std::atomic<int64_t> overruns[PHASE_COUNT] = {};
+
+public:
+    void setMaxCatchUpTicks(int p_ticks) { maxCatchUpTicks = p_ticks; }
+    int getMaxCatchUpTicks() const { return maxCatchUpTicks; }
+
+    void setFrameBudget(double seconds) { frameBudget = seconds; }
+    void setBudgetShare(Phase phase, double share) { budgetShare[phase] = share; }
+    double getBudgetShare(Phase phase) const { return budgetShare[phase]; }
+    double getBudget(Phase phase) const { return frameBudget * budgetShare[phase]; }
+
+    // Adds delta to the backlog and returns how many ticks to run this frame
+    int schedule(double delta, double tickRate) {
+        if (tickRate <= 0.0) {
+            backlog = 0.0;
+            return 0;
+        }
+
+        double timePerTick = 1.0 / tickRate;
+        backlog += delta;
+        int due = static_cast<int>(backlog / timePerTick);
+        backlog -= due * timePerTick;
+
+        if (due > maxCatchUpTicks) {
+            droppedTicks += due - maxCatchUpTicks;
+            due = maxCatchUpTicks;
+        }
+        return due;
+    }
+
+    [[nodiscard]] bool withinBudget(Phase phase, double elapsed) const {
+        return elapsed <= getBudget(phase);
+    }
+
+    // Whether a whole frame, simulation and rendering together, took longer than the budget
+    [[nodiscard]] bool overran(double frameSeconds) const {
+        return frameSeconds > frameBudget;
+    }
+
+    void tickDone() { ++ticks; }
+
+    // For ticks that were scheduled but skipped because their phase ran out of budget
+    void drop(int count) { droppedTicks += count; }
+
+    // Returns false if the phase went over its budget
+    bool record(Phase phase, double elapsed) {
+        if (!withinBudget(phase, elapsed)) {
+            ++overruns[phase];
+            return false;
+        }
+        return true;
+    }
+
+    int64_t getTicks() const { return ticks; }
+    int64_t getDroppedTicks() const { return droppedTicks; }
+    int64_t getOverruns(Phase phase) const { return overruns[phase]; }
+};
+
+
+#endif //TICKSCHEDULER_H
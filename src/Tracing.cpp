@@ -0,0 +1,209 @@
+#include "Tracing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+    std::mutex internMutex;
+    std::unordered_set<std::string> interned;
+
+#ifdef FISHBYTES_TRACING
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point epoch = Clock::now();
+
+    uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+    }
+
+    struct Event {
+        const char* name;
+        const char* detail;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    // Written only by its own thread. Readers copy it and then discard whatever the writer may
+    // have overwritten in the meantime, so recording never waits.
+    struct Ring {
+        int id = 0;
+        const char* threadName = nullptr;
+        std::unique_ptr<Event[]> events{new Event[Tracing::RING_SIZE]};
+        std::atomic<uint64_t> head = 0;
+        // Set once its thread is gone; guarded by ringsMutex
+        bool exited = false;
+
+        void push(const Event& event) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            events[h & (Tracing::RING_SIZE - 1)] = event;
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    // A thread's ring outlives it, so its zones can still be dumped, until the next dump or until
+    // more than MAX_EXITED_RINGS threads have exited since. Rings of exited threads are then reused
+    // by new threads, so short-lived ones (autosave compaction, slow tick captures) don't each
+    // leave a ring behind.
+    constexpr size_t MAX_EXITED_RINGS = 4;
+
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<std::unique_ptr<Ring>> freeRings;
+    int nextRingId = 1;
+
+    // Takes the oldest rings of exited threads out of rings, keeping the newest `keep`
+    void releaseExitedRings(size_t keep) {
+        size_t exited = std::count_if(rings.begin(), rings.end(), [](const auto& ring) { return ring->exited; });
+        for (auto it = rings.begin(); it != rings.end() && exited > keep;) {
+            if ((*it)->exited) {
+                if (freeRings.size() < MAX_EXITED_RINGS) {
+                    freeRings.push_back(std::move(*it));
+                }
+                it = rings.erase(it);
+                --exited;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Hands the calling thread a ring on first use and gives it back when the thread exits
+    struct RingOwner {
+        Ring* ring = nullptr;
+
+        ~RingOwner() {
+            if (ring) {
+                std::lock_guard lock(ringsMutex);
+                ring->exited = true;
+                releaseExitedRings(MAX_EXITED_RINGS);
+            }
+        }
+    };
+
+    Ring& localRing() {
+        thread_local RingOwner owner;
+        if (!owner.ring) {
+            std::lock_guard lock(ringsMutex);
+            if (freeRings.empty()) {
+                rings.push_back(std::make_unique<Ring>());
+            } else {
+                rings.push_back(std::move(freeRings.back()));
+                freeRings.pop_back();
+            }
+            owner.ring = rings.back().get();
+            owner.ring->id = nextRingId++;
+            owner.ring->threadName = nullptr;
+            owner.ring->head.store(0, std::memory_order_relaxed);
+            owner.ring->exited = false;
+        }
+        return *owner.ring;
+    }
+
+    void appendEscaped(std::string& out, const char* str) {
+        for (; *str; ++str) {
+            if (*str == '"' || *str == '\\') {
+                out += '\\';
+            }
+            out += *str;
+        }
+    }
+#endif
+}
+
+bool Tracing::isEnabled() {
+#ifdef FISHBYTES_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* Tracing::intern(const String& str) {
+    std::lock_guard lock(internMutex);
+    return interned.emplace(str.utf8().get_data()).first->c_str();
+}
+
+#ifdef FISHBYTES_TRACING
+Tracing::Zone::Zone(const char* name, const char* detail) : name(name), detail(detail), start(now()) {}
+
+Tracing::Zone::~Zone() {
+    localRing().push({name, detail, start, now() - start});
+}
+
+void Tracing::setThreadName(const char* name) {
+    Ring& ring = localRing();
+    std::lock_guard lock(ringsMutex);
+    ring.threadName = name;
+}
+
+bool Tracing::writeChromeTrace(const String& path) {
+    std::string json = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    char buffer[128];
+
+    std::lock_guard lock(ringsMutex);
+    for (const auto& ring : rings) {
+        if (ring->threadName) {
+            json += first ? "" : ",\n";
+            first = false;
+            std::snprintf(buffer, sizeof(buffer), "{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": \"", ring->id);
+            json += buffer;
+            appendEscaped(json, ring->threadName);
+            json += "\"}}";
+        }
+
+        uint64_t end = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+        std::vector<Event> events(end - begin);
+        for (uint64_t i = begin; i < end; ++i) {
+            events[i - begin] = ring->events[i & (RING_SIZE - 1)];
+        }
+
+        // Skip anything the thread overwrote while it was being copied, including the slot it may be
+        // writing right now. The fence keeps the copy from being read after head.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = ring->head.load(std::memory_order_relaxed);
+        uint64_t valid = after >= RING_SIZE ? after - RING_SIZE + 1 : 0;
+        for (uint64_t i = std::max(begin, valid); i < end; ++i) {
+            const Event& event = events[i - begin];
+            json += first ? "" : ",\n";
+            first = false;
+            json += "{\"ph\": \"X\", \"cat\": \"fishbytes\", \"name\": \"";
+            appendEscaped(json, event.name);
+            std::snprintf(buffer, sizeof(buffer), "\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                          ring->id, event.start / 1e3, event.duration / 1e3);
+            json += buffer;
+            if (event.detail) {
+                json += ", \"args\": {\"detail\": \"";
+                appendEscaped(json, event.detail);
+                json += "\"}";
+            }
+            json += "}";
+        }
+    }
+    // Exited threads' zones are in this dump, so their rings can go to new threads
+    releaseExitedRings(0);
+    json += "\n]}\n";
+
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::WRITE);
+    if (file.is_null()) {
+        UtilityFunctions::printerr("Failed to save trace to file: ", path);
+        return false;
+    }
+    file->store_string(String::utf8(json.c_str(), static_cast<int64_t>(json.size())));
+    return true;
+}
+#else
+void Tracing::setThreadName(const char* name) {}
+
+bool Tracing::writeChromeTrace(const String& path) {
+    UtilityFunctions::printerr("Tracing is disabled; rebuild with `scons tracing=yes`");
+    return false;
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include "godot_includes.h"
+
+// Scoped timeline zones, e.g.
+//     TRACE_ZONE("GameState::process");
+//     TRACE_ZONE_DETAIL("Entity::process", properties->traceName);
+// Each thread records into its own ring buffer (the last RING_SIZE zones), and
+// Tracing::writeChromeTrace dumps all of them for chrome://tracing or Perfetto. Threads that
+// exited are included in the next dump, after which their rings are reused.
+//
+// Zones are only compiled in when building with `scons tracing=yes`; otherwise they cost nothing.
+class Tracing {
+public:
+    static constexpr size_t RING_SIZE = 1 << 16;
+
+    // Whether zones were compiled in
+    static bool isEnabled();
+
+    // Returns a copy of the string that lives as long as the program, for use as a zone name or detail
+    static const char* intern(const String& str);
+
+    // Names the calling thread in the dump
+    static void setThreadName(const char* name);
+
+    // Writes every thread's recorded zones as Chrome trace event JSON
+    static bool writeChromeTrace(const String& path);
+
+#ifdef FISHBYTES_TRACING
+    class Zone {
+        const char* name;
+        const char* detail;
+        uint64_t start;
+
+    public:
+        explicit Zone(const char* name, const char* detail = nullptr);
+        ~Zone();
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+    };
+#endif
+};
+
+#ifdef FISHBYTES_TRACING
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) Tracing::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_ZONE_DETAIL(name, detail) Tracing::Zone TRACE_CONCAT(traceZone, __LINE__)(name, detail)
+#else
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_ZONE_DETAIL(name, detail) ((void)0)
+#endif
+
+
+#endif //TRACING_H
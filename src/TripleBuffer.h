@@ -0,0 +1,44 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Wait-free hand-off of the latest value from one writer thread to one reader thread.
+// The writer fills writeBuffer() and publishes it; the reader picks up the most recently
+// published buffer with acquire() and may keep reading it until its next acquire().
+// Neither side ever blocks, and values the reader didn't get to in time are skipped.
+template <typename T>
+class TripleBuffer {
+    static constexpr uint8_t INDEX_MASK = 0b011;
+    static constexpr uint8_t FRESH = 0b100;
+
+    T buffers[3];
+
+    // Index of the buffer that is neither being written nor read, plus whether it holds
+    // a value the reader hasn't seen yet
+    std::atomic<uint8_t> middle{1};
+    uint8_t back = 0;
+    uint8_t front = 2;
+
+public:
+    T& writeBuffer() { return buffers[back]; }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Returns whether a new value was published since the last call
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const { return buffers[front]; }
+};
+
+
+#endif //TRIPLEBUFFER_H
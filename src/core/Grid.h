@@ -0,0 +1,470 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "MaterialTable.h"
+#include "Random.h"
+#include "Vec2i.h"
+
+struct Pixel {
+    MaterialId material{MaterialTable::AIR};
+    char colorOffset{0};
+
+    static constexpr int MAX_SHADE = 3;
+
+    Pixel(MaterialId material, Random& random)
+        : material(material) {
+        // set to random color offset between -3 and 3
+        colorOffset = static_cast<char>(random.range(-MAX_SHADE, MAX_SHADE));
+    }
+
+    // Leaves the offset at 0 for position shaded materials, without using up a random number
+    Pixel(MaterialId material, const MaterialInfo& info, Random& random)
+        : material(material) {
+        if (!info.positionShaded) {
+            colorOffset = static_cast<char>(random.range(-MAX_SHADE, MAX_SHADE));
+        }
+    }
+
+    explicit Pixel() = default;
+
+    // The color offset of a position shaded tile, between -MAX_SHADE and MAX_SHADE
+    static int shadeAt(const int x, const int y, const MaterialId material) {
+        uint32_t h = static_cast<uint32_t>(x) * 0x9E3779B1u ^ static_cast<uint32_t>(y) * 0x85EBCA77u ^ material * 0xC2B2AE3Du;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 13;
+        return static_cast<int>(h % (2 * MAX_SHADE + 1)) - MAX_SHADE;
+    }
+
+    bool operator==(const Pixel&) const = default;
+};
+
+struct Grid {
+    // Side length of the square chunks used to track which parts of the grid changed
+    static constexpr int CHUNK_SHIFT = 4;
+    static constexpr int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+    static constexpr int CHUNK_AREA = CHUNK_SIZE * CHUNK_SIZE;
+
+    // Builds with FISHBYTES_TILED_GRID (`scons tiled_grid=yes`) store the tiles chunk by chunk, in the
+    // same order as the chunk flags and each chunk row by row, instead of row by row. A chunk is then
+    // one contiguous 1 KiB block, so square neighborhoods stay within a page or two however wide the
+    // grid is, at the cost of a table lookup per access. Partial chunks at the right and top edges are
+    // padded with tiles that are never simulated. Either way, each chunk row is contiguous.
+    //
+    // Tiled grids also store chunks whose tiles are all the same (like untouched air) only once: all
+    // chunks that are uniform in the same way share a read-only block of data, and a chunk gets a
+    // block of its own on the first write to it. At the end of each tick, chunks that were written
+    // to are checked for having become uniform again.
+#ifdef FISHBYTES_TILED_GRID
+    static constexpr bool TILED = true;
+#else
+    static constexpr bool TILED = false;
+#endif
+
+    // Use index(), get(), operator[] or getRowSpan() rather than assuming a layout
+    std::vector<Pixel> data;
+    std::vector<uint8_t> updated;
+    std::vector<bool> dirtyChunks;
+    Vec2i size;
+    Vec2i chunkCount;
+
+    // Activity counters: tiles swapped since the owner last reset it, and the number of chunks
+    // touched during the last tick
+    int64_t moves = 0;
+    // Ticks simulated so far, which decides when slow materials get their turn
+    int64_t tick = 0;
+    std::vector<uint8_t> activeChunks;
+    int activeChunkCount = 0;
+
+    // Chunks next to one touched this tick or the last. Tiles only look at their direct neighbors, so
+    // anywhere else nothing can happen that didn't already happen (or not) last tick, and the
+    // simulation skips those chunks.
+    std::vector<uint8_t> awakeChunks;
+
+    // Tiles written in each chunk this tick, and for each chunk the ticks since a tile in it or next
+    // to it was last written. Slow materials keep their chunk awake only while that is recent enough
+    // for them to still have a turn pending.
+    std::vector<uint8_t> changedChunks;
+    std::vector<int> quietTicks;
+
+    // Where each row and column would start if every chunk had its own block in order (chunk index
+    // times CHUNK_AREA plus the position within the chunk), so finding a tile is two lookups and an add
+    std::vector<int> rowOffsets;
+    std::vector<int> columnOffsets;
+
+    // The block in data holding each chunk's tiles, whether each block is shared, the shared blocks,
+    // and blocks that are no longer used by any chunk
+    std::vector<int> chunkBlocks;
+    std::vector<uint8_t> sharedBlocks;
+    std::vector<int> uniformBlocks;
+    std::vector<int> freeBlocks;
+    // Chunks that got a block of their own this tick
+    std::vector<int> ownedChunks;
+
+    // Position of a tile in data and updated
+    [[nodiscard]] int index(const int x, const int y) const {
+        assert(x >= 0 && x < size.x && y >= 0 && y < size.y);
+        if constexpr (TILED) {
+            const int tile = rowOffsets[y] + columnOffsets[x];
+            return chunkBlocks[tile >> (2 * CHUNK_SHIFT)] * CHUNK_AREA + (tile & (CHUNK_AREA - 1));
+        } else {
+            return y * size.x + x;
+        }
+    }
+
+    [[nodiscard]] const Pixel& get(const int x, const int y) const {
+        return data[index(x, y)];
+    }
+
+    // For writing: gives the tile's chunk a block of its own first, so read with get() instead
+    Pixel& operator[](const int x, const int y) {
+        materialize(x, y);
+        return data[index(x, y)];
+    }
+
+    const Pixel& operator[](int x, int y) const {
+        return data[index(x, y)];
+    }
+
+    // The tile every tile of the chunk is equal to, if it is stored as uniform. Always null for
+    // grids that aren't tiled.
+    [[nodiscard]] const Pixel* getUniformTile(const int cx, const int cy) const {
+        if constexpr (TILED) {
+            const int block = chunkBlocks[cy * chunkCount.x + cx];
+            if (sharedBlocks[block]) {
+                return &data[block * CHUNK_AREA];
+            }
+        }
+        return nullptr;
+    }
+
+    // Gives the tile's chunk a block of its own if it shares one. Needed before writing to data or
+    // updated directly, and moves data, so indices and pointers taken before it are invalidated.
+    void materialize(const int x, const int y) {
+        if constexpr (TILED) {
+            const int chunk = (y >> CHUNK_SHIFT) * chunkCount.x + (x >> CHUNK_SHIFT);
+            if (sharedBlocks[chunkBlocks[chunk]]) {
+                ownChunk(chunk);
+            }
+        }
+    }
+
+    // The tiles of row y in chunk column cx, which are contiguous. Only the first
+    // min(CHUNK_SIZE, size.x - cx * CHUNK_SIZE) of them are in the grid.
+    [[nodiscard]] const Pixel* getRowSpan(const int cx, const int y) const {
+        return &data[index(cx * CHUNK_SIZE, y)];
+    }
+
+    // Copies the tiles out row by row, the way images and saves expect them
+    void copyRows(std::vector<Pixel>& rows) const {
+        rows.resize(size.x * size.y);
+        for (int y = 0; y < size.y; ++y) {
+            for (int cx = 0; cx < chunkCount.x; ++cx) {
+                const int x = cx * CHUNK_SIZE;
+                std::memcpy(&rows[y * size.x + x], getRowSpan(cx, y), std::min(CHUNK_SIZE, size.x - x) * sizeof(Pixel));
+            }
+        }
+    }
+
+    // Sets every tile to p, without marking anything
+    void fill(const Pixel& p) {
+        if constexpr (TILED) {
+            data.assign(CHUNK_AREA, p);
+            updated.assign(CHUNK_AREA, false);
+            chunkBlocks.assign(chunkCount.x * chunkCount.y, 0);
+            sharedBlocks.assign(1, true);
+            uniformBlocks.assign(1, 0);
+            freeBlocks.clear();
+            ownedChunks.clear();
+        } else {
+            data.assign(data.size(), p);
+        }
+    }
+
+    // Copies the tiles of a grid of the same size, leaving uniform chunks shared
+    void copyTiles(const Grid& other) {
+        assert(other.size == size);
+        data = other.data;
+        updated.assign(data.size(), false);
+        chunkBlocks = other.chunkBlocks;
+        sharedBlocks = other.sharedBlocks;
+        uniformBlocks = other.uniformBlocks;
+        freeBlocks = other.freeBlocks;
+        ownedChunks.clear();
+    }
+
+    // Blocks of data in use, shared ones included. Without tiling, the grid is one block.
+    [[nodiscard]] int getBlockCount() const {
+        return TILED ? static_cast<int>(sharedBlocks.size() - freeBlocks.size()) : 1;
+    }
+
+    // Bytes held by the tiles and the per-chunk bookkeeping (capacity, not just what is in use)
+    [[nodiscard]] size_t getMemoryUsage() const {
+        auto bytes = [](const auto& v) { return v.capacity() * sizeof(v[0]); };
+        return bytes(data) + bytes(updated) + dirtyChunks.capacity() / 8 + bytes(activeChunks) + bytes(awakeChunks)
+             + bytes(changedChunks) + bytes(quietTicks)
+             + bytes(rowOffsets) + bytes(columnOffsets) + bytes(chunkBlocks) + bytes(sharedBlocks)
+             + bytes(uniformBlocks) + bytes(freeBlocks) + bytes(ownedChunks);
+    }
+
+    bool wasUpdated(const int x, const int y) {
+        const int i = index(x, y);
+        return updated[i] && data[i].material != MaterialTable::AIR;
+    }
+
+    void setUpdated(const int x, const int y) {
+        updated[index(x, y)] = true;
+    }
+
+    void set(const int x, const int y, const Pixel& p) {
+        // Writing what a uniform chunk already holds leaves it shared
+        const Pixel* uniform = getUniformTile(x >> CHUNK_SHIFT, y >> CHUNK_SHIFT);
+        if (!uniform || !(*uniform == p)) {
+            (*this)[x, y] = p;
+        }
+        markDirty(x, y);
+    }
+
+    void markDirty(const int x, const int y) {
+        const int chunk = (y / CHUNK_SIZE) * chunkCount.x + x / CHUNK_SIZE;
+        dirtyChunks[chunk] = true;
+        changedChunks[chunk] = true;
+        keepAwake(x, y);
+    }
+
+    // Counts the tile's chunk as active without anything to save, so it stays awake next tick
+    void keepAwake(const int x, const int y) {
+        const int chunk = (y / CHUNK_SIZE) * chunkCount.x + x / CHUNK_SIZE;
+        if (!activeChunks[chunk]) {
+            activeChunks[chunk] = true;
+            wakeAround(x / CHUNK_SIZE, y / CHUNK_SIZE);
+        }
+    }
+
+    void wakeAround(const int cx, const int cy) {
+        for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, chunkCount.y - 1); ++ny) {
+            for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, chunkCount.x - 1); ++nx) {
+                awakeChunks[ny * chunkCount.x + nx] = true;
+            }
+        }
+    }
+
+    [[nodiscard]] bool isChunkAwake(const int cx, const int cy) const {
+        return awakeChunks[cy * chunkCount.x + cx];
+    }
+
+    // Ticks finished since the last one that wrote to the tile's chunk or a chunk next to it
+    [[nodiscard]] int getQuietTicks(const int x, const int y) const {
+        return quietTicks[(y / CHUNK_SIZE) * chunkCount.x + x / CHUNK_SIZE];
+    }
+
+    // For changes that bypass markDirty, like materials changing behavior
+    void wakeAll() {
+        awakeChunks.assign(awakeChunks.size(), true);
+        quietTicks.assign(quietTicks.size(), 0);
+    }
+
+    [[nodiscard]] bool isChunkDirty(const int cx, const int cy) const {
+        return dirtyChunks[cy * chunkCount.x + cx];
+    }
+
+    void markAllDirty() {
+        dirtyChunks.assign(dirtyChunks.size(), true);
+        wakeAll();
+    }
+
+    void clearDirtyChunks() {
+        dirtyChunks.assign(dirtyChunks.size(), false);
+    }
+
+    void finalizeUpdate() {
+        updated.assign(updated.size(), false);
+
+        activeChunkCount = 0;
+        awakeChunks.assign(awakeChunks.size(), false);
+        for (int& quiet : quietTicks) {
+            quiet += quiet < std::numeric_limits<int>::max();
+        }
+        for (int cy = 0; cy < chunkCount.y; ++cy) {
+            for (int cx = 0; cx < chunkCount.x; ++cx) {
+                if (activeChunks[cy * chunkCount.x + cx]) {
+                    ++activeChunkCount;
+                    wakeAround(cx, cy);
+                }
+                if (changedChunks[cy * chunkCount.x + cx]) {
+                    for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, chunkCount.y - 1); ++ny) {
+                        for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, chunkCount.x - 1); ++nx) {
+                            quietTicks[ny * chunkCount.x + nx] = 0;
+                        }
+                    }
+                }
+            }
+        }
+        changedChunks.assign(changedChunks.size(), false);
+        if constexpr (TILED) {
+            shareUniformChunks();
+        }
+        activeChunks.assign(activeChunks.size(), false);
+        ++tick;
+    }
+
+    void swapTiles(const int x1, const int y1, const int x2, const int y2) {
+        assert(x1 >= 0 && x1 < size.x && y1 >= 0 && y1 < size.y);
+        assert(x2 >= 0 && x2 < size.x && y2 >= 0 && y2 < size.y);
+        materialize(x1, y1);
+        materialize(x2, y2);
+        std::swap(data[index(x1, y1)], data[index(x2, y2)]);
+        setUpdated(x1, y1);
+        setUpdated(x2, y2);
+        ++moves;
+        markDirty(x1, y1);
+        markDirty(x2, y2);
+    }
+
+    void reset(Vec2i sz) {
+        size = sz;
+        chunkCount = {(size.x + CHUNK_SIZE - 1) / CHUNK_SIZE, (size.y + CHUNK_SIZE - 1) / CHUNK_SIZE};
+
+        if constexpr (TILED) {
+            fill(Pixel{});
+
+            rowOffsets.resize(size.y);
+            for (int y = 0; y < size.y; ++y) {
+                rowOffsets[y] = (y >> CHUNK_SHIFT) * chunkCount.x * CHUNK_AREA + (y & (CHUNK_SIZE - 1)) * CHUNK_SIZE;
+            }
+            columnOffsets.resize(size.x);
+            for (int x = 0; x < size.x; ++x) {
+                columnOffsets[x] = (x >> CHUNK_SHIFT) * CHUNK_AREA + (x & (CHUNK_SIZE - 1));
+            }
+        } else {
+            data.clear();
+            data.resize(size.x * size.y);
+
+            updated.clear();
+            updated.resize(size.x * size.y);
+        }
+
+        // A fresh grid counts as entirely changed
+        dirtyChunks.assign(chunkCount.x * chunkCount.y, true);
+        activeChunks.assign(chunkCount.x * chunkCount.y, false);
+        awakeChunks.assign(chunkCount.x * chunkCount.y, true);
+        changedChunks.assign(chunkCount.x * chunkCount.y, false);
+        quietTicks.assign(chunkCount.x * chunkCount.y, 0);
+    }
+
+    explicit Grid(Vec2i size) {
+        reset(size);
+    }
+
+private:
+    void ownChunk(const int chunk) {
+        const Pixel uniform = data[chunkBlocks[chunk] * CHUNK_AREA];
+        int block;
+        if (freeBlocks.empty()) {
+            block = static_cast<int>(sharedBlocks.size());
+            sharedBlocks.push_back(false);
+            data.resize(data.size() + CHUNK_AREA);
+            updated.resize(updated.size() + CHUNK_AREA);
+        } else {
+            block = freeBlocks.back();
+            freeBlocks.pop_back();
+            sharedBlocks[block] = false;
+        }
+        std::fill_n(data.begin() + block * CHUNK_AREA, CHUNK_AREA, uniform);
+        std::fill_n(updated.begin() + block * CHUNK_AREA, CHUNK_AREA, false);
+        chunkBlocks[chunk] = block;
+        ownedChunks.push_back(chunk);
+    }
+
+    // Moves chunks written to this tick whose tiles are all equal back onto a shared block
+    void shareUniformChunks() {
+        auto share = [&](const int chunk) {
+            const int block = chunkBlocks[chunk];
+            if (sharedBlocks[block]) {
+                return;
+            }
+            // Only the part in the grid counts, the padding is never read
+            const int cx = chunk % chunkCount.x, cy = chunk / chunkCount.x;
+            const int width = std::min(CHUNK_SIZE, size.x - cx * CHUNK_SIZE);
+            const int height = std::min(CHUNK_SIZE, size.y - cy * CHUNK_SIZE);
+            const Pixel* tiles = &data[block * CHUNK_AREA];
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    if (!(tiles[y * CHUNK_SIZE + x] == tiles[0])) {
+                        return;
+                    }
+                }
+            }
+
+            auto shared = std::find_if(uniformBlocks.begin(), uniformBlocks.end(), [&](int b) {
+                return data[b * CHUNK_AREA] == tiles[0];
+            });
+            if (shared == uniformBlocks.end()) {
+                // The block becomes the shared one, padding and all
+                std::fill_n(data.begin() + block * CHUNK_AREA, CHUNK_AREA, tiles[0]);
+                sharedBlocks[block] = true;
+                uniformBlocks.push_back(block);
+            } else {
+                chunkBlocks[chunk] = *shared;
+                freeBlocks.push_back(block);
+            }
+        };
+        for (int chunk : ownedChunks) {
+            share(chunk);
+        }
+        for (int chunk = 0; chunk < chunkCount.x * chunkCount.y; ++chunk) {
+            if (activeChunks[chunk]) {
+                share(chunk);
+            }
+        }
+        ownedChunks.clear();
+
+        // Give memory back once most blocks are unused
+        if (freeBlocks.size() > sharedBlocks.size() / 2) {
+            compactBlocks();
+        }
+    }
+
+    void compactBlocks() {
+        std::vector<int> moved(sharedBlocks.size(), -1);
+        int count = 0;
+        for (int& block : chunkBlocks) {
+            if (moved[block] == -1) {
+                moved[block] = count++;
+            }
+        }
+
+        std::vector<Pixel> compacted(count * CHUNK_AREA);
+        std::vector<uint8_t> shared(count);
+        for (size_t block = 0; block < moved.size(); ++block) {
+            if (moved[block] != -1) {
+                std::copy_n(data.begin() + block * CHUNK_AREA, CHUNK_AREA, compacted.begin() + moved[block] * CHUNK_AREA);
+                shared[moved[block]] = sharedBlocks[block];
+            }
+        }
+        for (int& block : chunkBlocks) {
+            block = moved[block];
+        }
+        // Shared blocks no chunk uses anymore are dropped
+        std::erase_if(uniformBlocks, [&](int block) { return moved[block] == -1; });
+        for (int& block : uniformBlocks) {
+            block = moved[block];
+        }
+
+        data = std::move(compacted);
+        sharedBlocks = std::move(shared);
+        // Only called at the end of a tick, when nothing is marked updated
+        updated.assign(data.size(), false);
+        freeBlocks.clear();
+    }
+};
+
+
+#endif //GRID_H
@@ -0,0 +1,209 @@
+#include "MargolusSimulator.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+    constexpr int BL = 0, BR = 1, TL = 2, TR = 3;
+    // Fewer block rows than this aren't worth handing to another thread
+    constexpr int MIN_BLOCK_ROWS_PER_THREAD = 32;
+
+    // Whether a tile of the first class may swap places with one of the second
+    bool enters(MargolusSimulator::CellClass mover, MargolusSimulator::CellClass target) {
+        using M = MargolusSimulator;
+        return (mover == M::POWDER && (target == M::EMPTY || target == M::FLUID))
+            || (mover == M::FLUID && target == M::EMPTY);
+    }
+
+    MargolusSimulator::CellClass classOf(const MaterialInfo& info) {
+        switch (info.type) {
+            case MaterialInfo::EMPTY:
+                return MargolusSimulator::EMPTY;
+            case MaterialInfo::FLUID:
+                return MargolusSimulator::FLUID;
+            case MaterialInfo::GRAVITY:
+                return MargolusSimulator::POWDER;
+            default:
+                return MargolusSimulator::WALL;
+        }
+    }
+
+    struct Block {
+        int x, y;
+        int key;
+        uint8_t permutation;
+    };
+
+    // What one thread did during a pass, applied to the grid once all threads are done
+    struct PassResult {
+        int64_t movedTiles = 0;
+        std::vector<int> touchedChunks;
+        // Blocks that write to a chunk without a block of data of its own (see Grid). Giving it one
+        // moves the grid's data, so that waits until the other threads are done.
+        std::vector<Block> deferred;
+    };
+
+    // Moves the tiles of the block at (x, y) as the permutation says
+    void applyBlock(Grid& grid, const Block& block, PassResult& result) {
+        const int xs[4] = {block.x, block.x + 1, block.x, block.x + 1};
+        const int ys[4] = {block.y, block.y, block.y + 1, block.y + 1};
+
+        // Walls never move, so only in-grid tiles are read and written
+        Pixel before[4];
+        for (int i = 0; i < 4; ++i) {
+            if ((block.key >> (2 * i) & 3) != MargolusSimulator::WALL) {
+                before[i] = grid.get(xs[i], ys[i]);
+            }
+        }
+        for (int i = 0; i < 4; ++i) {
+            const int source = block.permutation >> (2 * i) & 3;
+            if (source == i) {
+                continue;
+            }
+            grid.data[grid.index(xs[i], ys[i])] = before[source];
+            ++result.movedTiles;
+            const int chunk = (ys[i] / Grid::CHUNK_SIZE) * grid.chunkCount.x + xs[i] / Grid::CHUNK_SIZE;
+            if (result.touchedChunks.empty() || result.touchedChunks.back() != chunk) {
+                result.touchedChunks.push_back(chunk);
+            }
+        }
+    }
+
+    // Resolves the blocks with their bottom left tile at (2i - offset, y) for y in [firstRow, endRow)
+    // stepping by two. Blocks at the edges may hang off the grid.
+    void processBlocks(Grid& grid, const std::vector<uint8_t>& classes, int offset, int firstRow, int endRow, PassResult& result) {
+        const MargolusSimulator::Table& table = MargolusSimulator::getTable();
+        const int width = grid.size.x;
+        const int height = grid.size.y;
+
+        for (int y = firstRow; y < endRow; y += 2) {
+            for (int x = -offset; x < width; x += 2) {
+                const int xs[4] = {x, x + 1, x, x + 1};
+                const int ys[4] = {y, y, y + 1, y + 1};
+
+                // Any in-grid tile tells whether the block can have changed since it last settled
+                const int cx = std::max(x, 0) / Grid::CHUNK_SIZE;
+                const int cy = std::max(y, 0) / Grid::CHUNK_SIZE;
+                if (!grid.isChunkAwake(cx, cy)) {
+                    continue;
+                }
+
+                int key = 0;
+                for (int i = 0; i < 4; ++i) {
+                    const bool inside = xs[i] >= 0 && xs[i] < width && ys[i] >= 0 && ys[i] < height;
+                    const int cellClass = inside ? classes[grid.get(xs[i], ys[i]).material] : int{MargolusSimulator::WALL};
+                    key |= cellClass << (2 * i);
+                }
+                const uint8_t permutation = table[key];
+                if (permutation == MargolusSimulator::IDENTITY) {
+                    continue;
+                }
+
+                const Block block{x, y, key, permutation};
+                bool shared = false;
+                for (int i = 0; i < 4; ++i) {
+                    if ((permutation >> (2 * i) & 3) != i) {
+                        shared |= grid.getUniformTile(xs[i] / Grid::CHUNK_SIZE, ys[i] / Grid::CHUNK_SIZE) != nullptr;
+                    }
+                }
+                if (shared) {
+                    result.deferred.push_back(block);
+                } else {
+                    applyBlock(grid, block, result);
+                }
+            }
+        }
+    }
+}
+
+MargolusSimulator::Table MargolusSimulator::buildTable() {
+    Table table{};
+    for (int key = 0; key < BLOCKS; ++key) {
+        CellClass cells[4];
+        uint8_t sources[4] = {BL, BR, TL, TR};
+        bool moved[4] = {};
+        for (int i = 0; i < 4; ++i) {
+            cells[i] = static_cast<CellClass>(key >> (2 * i) & 3);
+        }
+        auto swap = [&](int a, int b) {
+            std::swap(cells[a], cells[b]);
+            std::swap(sources[a], sources[b]);
+            moved[a] = moved[b] = true;
+        };
+
+        // Fall straight down
+        for (int column : {0, 1}) {
+            if (enters(cells[TL + column], cells[BL + column])) {
+                swap(TL + column, BL + column);
+            }
+        }
+        // Topple diagonally off whatever is below. Each top tile can only reach the bottom tile the
+        // other one would fall into, so the two never compete.
+        for (int column : {0, 1}) {
+            const int top = TL + column, below = BL + column, diagonal = BL + 1 - column;
+            if (!moved[top] && !moved[diagonal] && !enters(cells[top], cells[below]) && enters(cells[top], cells[diagonal])) {
+                swap(top, diagonal);
+            }
+        }
+        // Fluids that are still in place spread sideways. That includes the bottom row, which can't see
+        // what is below it, since with only the top row a puddle would stay between the same two columns.
+        for (int row : {BL, TL}) {
+            const int left = row, right = row + 1;
+            if (!moved[left] && !moved[right] && ((cells[left] == FLUID && cells[right] == EMPTY) || (cells[left] == EMPTY && cells[right] == FLUID))) {
+                swap(left, right);
+            }
+        }
+
+        table[key] = sources[0] | sources[1] << 2 | sources[2] << 4 | sources[3] << 6;
+    }
+    return table;
+}
+
+const MargolusSimulator::Table& MargolusSimulator::getTable() {
+    static const Table table = buildTable();
+    return table;
+}
+
+void MargolusSimulator::process(Grid &grid, const MaterialTable &materials, int threads) {
+    std::vector<uint8_t> classes(materials.size());
+    for (MaterialId id = 0; id < materials.size(); ++id) {
+        classes[id] = classOf(materials[id]);
+    }
+
+    // Two passes per tick so every tile gets both block alignments
+    for (int offset : {0, 1}) {
+        // Each thread takes a band of block rows
+        const int blockRows = (grid.size.y + offset + 1) / 2;
+        const int workers = std::clamp(threads, 1, std::max(blockRows / MIN_BLOCK_ROWS_PER_THREAD, 1));
+
+        std::vector<PassResult> results(workers);
+        pool.run(workers, [&](int w) {
+            const int begin = -offset + 2 * (blockRows * w / workers);
+            const int end = -offset + 2 * (blockRows * (w + 1) / workers);
+            processBlocks(grid, classes, offset, begin, end, results[w]);
+        });
+
+        // Blocks don't overlap, so applying some of them late changes nothing
+        for (PassResult& result : results) {
+            for (const Block& block : result.deferred) {
+                for (int i = 0; i < 4; ++i) {
+                    if ((block.permutation >> (2 * i) & 3) != i) {
+                        grid.materialize(block.x + (i & 1), block.y + (i >> 1));
+                    }
+                }
+                applyBlock(grid, block, result);
+            }
+        }
+
+        // Marking wakes neighboring chunks, which the next pass needs to see
+        for (const PassResult& result : results) {
+            // Tiles only ever trade places in pairs
+            grid.moves += result.movedTiles / 2;
+            for (int chunk : result.touchedChunks) {
+                grid.markDirty((chunk % grid.chunkCount.x) * Grid::CHUNK_SIZE, (chunk / grid.chunkCount.x) * Grid::CHUNK_SIZE);
+            }
+        }
+    }
+
+    grid.finalizeUpdate();
+}
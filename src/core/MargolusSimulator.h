@@ -0,0 +1,46 @@
+#ifndef MARGOLUSSIMULATOR_H
+#define MARGOLUSSIMULATOR_H
+
+#include <array>
+#include <cstdint>
+
+#include "Grid.h"
+#include "MaterialTable.h"
+#include "WorkerPool.h"
+
+// Alternative to MaterialSimulator that updates the grid in independent 2x2 blocks (a Margolus
+// neighborhood), shifting the block grid by one tile diagonally every other pass. Each block is
+// resolved by a lookup table on the types of its four tiles, so no block depends on another and
+// a pass can be split across threads with exactly the same result. Only material types matter in
+// this mode: rules, densities, dispersion and update intervals are ignored.
+//
+// Each simulator keeps its own worker threads (parked between passes), so reuse one across ticks.
+class MargolusSimulator {
+    WorkerPool pool;
+
+public:
+    // The block's tiles, numbered from the bottom left: BL, BR, TL, TR
+    enum CellClass : uint8_t {
+        EMPTY,
+        FLUID,
+        POWDER,
+        WALL, // static, or outside the grid
+    };
+
+    static constexpr int BLOCKS = 256;
+    // Indexed by the four classes (2 bits each, BL in the low bits). Entry bits 2i..2i+1 hold the
+    // tile that ends up at position i.
+    using Table = std::array<uint8_t, BLOCKS>;
+    static constexpr uint8_t IDENTITY = 0b11'10'01'00;
+
+    static const Table& getTable();
+
+    void process(Grid& grid, const MaterialTable& materials, int threads);
+
+private:
+    static Table buildTable();
+};
+
+
+
+#endif //MARGOLUSSIMULATOR_H
@@ -0,0 +1,147 @@
+#ifndef MATERIALRULES_H
+#define MATERIALRULES_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Vec2i.h"
+
+// Dense index into a MaterialTable. IDs are only meaningful for the table they came from.
+using MaterialId = uint16_t;
+
+// Table-driven material behavior. Each of the five cells a tile can move into is reduced to a
+// class, the five classes form a 10-bit neighborhood, and every material has an action compiled
+// for each of the 1024 possible neighborhoods. Rules are ordered (the first match wins) and are
+// only evaluated while compiling, so the tile loop is a handful of loads and one table read.
+struct MaterialRules {
+    // Classes depend on the tile looking at the neighbor as well as the neighbor itself
+    enum CellClass : uint8_t {
+        EMPTY,   // empty, or a fluid lighter than the tile: something it can displace
+        FLUID,   // a fluid at least as dense as the tile
+        SOLID,
+        BLOCKED, // outside the grid, or not solid but already moved this tick
+        CLASS_COUNT
+    };
+
+    enum Direction : uint8_t {
+        BELOW,
+        BELOW_LEFT,
+        BELOW_RIGHT,
+        LEFT,
+        RIGHT,
+        DIRECTION_COUNT
+    };
+
+    static constexpr Vec2i OFFSETS[DIRECTION_COUNT] = {{0, -1}, {-1, -1}, {1, -1}, {-1, 0}, {1, 0}};
+    static constexpr int NEIGHBORHOODS = 1 << (2 * DIRECTION_COUNT);
+    // How far FLOW may look sideways. Kept within a chunk so a tile only depends on neighboring chunks.
+    static constexpr int MAX_FLOW_DISTANCE = 16;
+
+    // Sets of classes, one bit per CellClass
+    static constexpr uint8_t ANY = (1u << CLASS_COUNT) - 1;
+    static constexpr uint8_t bit(CellClass c) { return 1u << c; }
+
+    static constexpr CellClass classAt(int neighborhood, Direction d) {
+        return static_cast<CellClass>((neighborhood >> (2 * d)) & 3);
+    }
+
+    struct Action {
+        enum Kind : uint8_t {
+            NONE,
+            MOVE,        // swap with the neighbor in direction
+            MOVE_EITHER, // swap with direction or other, picked at random
+            BECOME,      // turn into material
+            FLOW,        // move into the nearest EMPTY tile below a run of up to distance EMPTY tiles to the side,
+                         // or else a tile aside when pushed from above or along a ceiling
+        } kind = NONE;
+        Direction direction = BELOW;
+        Direction other = BELOW;
+        MaterialId material = 0;
+        uint8_t distance = 0;
+
+        bool operator==(const Action&) const = default;
+    };
+
+    struct Rule {
+        // The classes each neighbor may have for the rule to apply
+        std::array<uint8_t, DIRECTION_COUNT> when{ANY, ANY, ANY, ANY, ANY};
+        Action action;
+
+        [[nodiscard]] bool matches(int neighborhood) const {
+            for (int d = 0; d < DIRECTION_COUNT; ++d) {
+                if (!(when[d] & bit(classAt(neighborhood, static_cast<Direction>(d))))) {
+                    return false;
+                }
+            }
+            // Never move across the edge of the grid or into a cell that already moved
+            bool moves = action.kind == Action::MOVE || action.kind == Action::MOVE_EITHER;
+            bool eitherMoves = action.kind == Action::MOVE_EITHER;
+            return !(moves && classAt(neighborhood, action.direction) == BLOCKED)
+                && !(eitherMoves && classAt(neighborhood, action.other) == BLOCKED);
+        }
+    };
+
+    static Rule move(Direction direction, uint8_t into) {
+        Rule rule;
+        rule.when[direction] = into;
+        rule.action = {Action::MOVE, direction};
+        return rule;
+    }
+
+    static Rule moveEither(Direction direction, Direction other, uint8_t into) {
+        Rule rule;
+        rule.when[direction] = into;
+        rule.when[other] = into;
+        rule.action = {Action::MOVE_EITHER, direction, other};
+        return rule;
+    }
+
+    static Rule flow(int distance) {
+        Rule rule;
+        rule.action.kind = Action::FLOW;
+        rule.action.distance = distance;
+        return rule;
+    }
+
+    // A material's rules compiled for the tile loop
+    struct Program {
+        // The action for every neighborhood
+        std::vector<Action> actions;
+        // The directions any rule looks at or moves to, one bit per Direction. The others are left
+        // out of the neighborhood (as EMPTY), since they can't change the outcome.
+        uint8_t inspected = 0;
+        // Whether the material ever does anything
+        bool active = false;
+    };
+
+    static Program compile(const std::vector<Rule>& rules) {
+        Program program;
+        program.actions.resize(NEIGHBORHOODS);
+        for (int n = 0; n < NEIGHBORHOODS; ++n) {
+            for (const Rule& rule : rules) {
+                if (rule.matches(n)) {
+                    program.actions[n] = rule.action;
+                    break;
+                }
+            }
+            program.active |= program.actions[n].kind != Action::NONE;
+        }
+
+        for (const Rule& rule : rules) {
+            for (int d = 0; d < DIRECTION_COUNT; ++d) {
+                if (rule.when[d] != ANY) {
+                    program.inspected |= 1u << d;
+                }
+            }
+            // Needed to tell whether the move is possible at all
+            if (rule.action.kind == Action::MOVE || rule.action.kind == Action::MOVE_EITHER) {
+                program.inspected |= 1u << rule.action.direction | 1u << rule.action.other;
+            }
+        }
+        return program;
+    }
+};
+
+
+#endif //MATERIALRULES_H
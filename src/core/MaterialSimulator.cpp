@@ -0,0 +1,292 @@
+#include "MaterialSimulator.h"
+
+#include <algorithm>
+#include <bit>
+
+void MaterialSimulator::process(Grid &grid, const MaterialTable &materials, Random &random) {
+    static_assert(MaterialRules::MAX_FLOW_DISTANCE <= Grid::CHUNK_SIZE, "FLOW must stay within neighboring chunks");
+    std::vector<uint64_t> sand, open;
+
+    // Process tiles from bottom to top (and left to right)
+    for (int y = 0; y < grid.size.y; ++y) {
+        const int cy = y / Grid::CHUNK_SIZE;
+        bool awake = false;
+        for (int cx = 0; cx < grid.chunkCount.x && !awake; ++cx) {
+            awake = grid.isChunkAwake(cx, cy);
+        }
+        if (!awake || processSandRow(grid, y, materials, sand, open)) {
+            continue;
+        }
+
+        // Moves wake chunks as they go, so check each one when reaching it. Only the first and last
+        // column (and the bottom row) need their neighbors checked against the edges of the grid.
+        const int interiorStart = y > 0 ? 1 : grid.size.x;
+        const int interiorEnd = grid.size.x - 1;
+        for (int cx = 0; cx < grid.chunkCount.x; ++cx) {
+            if (!grid.isChunkAwake(cx, cy)) {
+                continue;
+            }
+            // Chunks that are all one idle material, most often air, have nothing to do
+            if (const Pixel* uniform = grid.getUniformTile(cx, cy); uniform && !materials.getActions(uniform->material)) {
+                continue;
+            }
+            const int start = cx * Grid::CHUNK_SIZE;
+            const int end = std::min(start + Grid::CHUNK_SIZE, grid.size.x);
+            int x = start;
+            for (; x < std::min(end, interiorStart); ++x) {
+                processTile<true>(grid, x, y, materials, random);
+            }
+            for (; x < std::min(end, interiorEnd); ++x) {
+                processTile<false>(grid, x, y, materials, random);
+            }
+            for (; x < end; ++x) {
+                processTile<true>(grid, x, y, materials, random);
+            }
+        }
+    }
+
+    grid.finalizeUpdate();
+}
+
+namespace {
+    // Border is false only when (x, y) is known to be inside the grid
+    template <bool Border>
+    MaterialRules::CellClass classify(Grid &grid, int x, int y, const MaterialRules::CellClass* classes) {
+        // Neighbors are never above the tile, so only three edges can be crossed
+        if (Border && (x < 0 || x >= grid.size.x || y < 0)) {
+            return MaterialRules::BLOCKED;
+        }
+        // Solids can't be entered either way, so only look up whether anything else already moved
+        MaterialRules::CellClass cellClass = classes[grid.get(x, y).material];
+        return cellClass != MaterialRules::SOLID && grid.wasUpdated(x, y) ? MaterialRules::BLOCKED : cellClass;
+    }
+
+    // Whether all five neighbors of the tile are in the grid
+    bool isInterior(const Grid &grid, int x, int y) {
+        return x > 0 && x < grid.size.x - 1 && y > 0;
+    }
+}
+
+template <bool Border>
+void MaterialSimulator::processTile(Grid &grid, int x, int y, const MaterialTable &materials, Random &random) {
+    const MaterialId material = grid.get(x, y).material;
+    const MaterialRules::Action* actions = materials.getActions(material);
+    if (!actions) {
+        return;
+    }
+
+    // Slow materials take turns by ID so they don't all act on the same tick. Sleeping assumes every
+    // tile already had the chance to act on its current surroundings, so until their turn comes they
+    // keep the chunk awake, but only while a turn since the last change nearby is still to come.
+    const MaterialInfo& info = materials[material];
+    if (info.updateInterval > 1 && (grid.tick + material) % info.updateInterval != 0) {
+        if (grid.getQuietTicks(x, y) < info.updateInterval - 1) {
+            grid.keepAwake(x, y);
+        }
+        return;
+    }
+
+    const uint8_t inspected = materials.getInspectedDirections(material);
+    const MaterialRules::CellClass* classes = materials.getClasses(material);
+    // Fast materials carry on from wherever they moved to, which may be on the border
+    bool moved = step<Border>(grid, x, y, materials, actions, inspected, classes, random);
+    for (int i = 1; moved && i < info.steps; ++i) {
+        moved = isInterior(grid, x, y)
+            ? step<false>(grid, x, y, materials, actions, inspected, classes, random)
+            : step<true>(grid, x, y, materials, actions, inspected, classes, random);
+    }
+}
+
+template <bool Border>
+bool MaterialSimulator::step(Grid &grid, int &x, int &y, const MaterialTable &materials, const MaterialRules::Action* actions,
+                             uint8_t inspected, const MaterialRules::CellClass* classes, Random &random) {
+    // Written out so every offset is a constant
+    int neighborhood = 0;
+    auto add = [&](MaterialRules::Direction d) {
+        if (inspected & (1u << d)) {
+            neighborhood |= classify<Border>(grid, x + MaterialRules::OFFSETS[d].x, y + MaterialRules::OFFSETS[d].y, classes) << (2 * d);
+        }
+    };
+    add(MaterialRules::BELOW);
+    add(MaterialRules::BELOW_LEFT);
+    add(MaterialRules::BELOW_RIGHT);
+    add(MaterialRules::LEFT);
+    add(MaterialRules::RIGHT);
+
+    const MaterialRules::Action& action = actions[neighborhood];
+    switch (action.kind) {
+        case MaterialRules::Action::NONE:
+            return false;
+        case MaterialRules::Action::MOVE_EITHER:
+        case MaterialRules::Action::MOVE: {
+            MaterialRules::Direction direction = action.kind == MaterialRules::Action::MOVE_EITHER && !random.coinFlip() ? action.other : action.direction;
+            const Vec2i offset = MaterialRules::OFFSETS[direction];
+            grid.swapTiles(x, y, x + offset.x, y + offset.y);
+            x += offset.x;
+            y += offset.y;
+            return true;
+        }
+        case MaterialRules::Action::BECOME:
+            grid[x, y] = Pixel{action.material, materials[action.material], random};
+            grid.setUpdated(x, y);
+            grid.markDirty(x, y);
+            return false;
+        case MaterialRules::Action::FLOW: {
+            // Distance to the nearest drop-off on one side, or 0 if there is none in reach. This looks
+            // further than the direct neighbors, so it always checks the edges.
+            auto dropOff = [&](int side) {
+                for (int distance = 1; distance <= action.distance; ++distance) {
+                    if (classify<true>(grid, x + side * distance, y, classes) != MaterialRules::EMPTY) {
+                        break;
+                    }
+                    if (classify<true>(grid, x + side * distance, y - 1, classes) == MaterialRules::EMPTY) {
+                        return distance;
+                    }
+                }
+                return 0;
+            };
+            const int left = dropOff(-1);
+            const int right = dropOff(1);
+            const int dx = left && (!right || left < right || (left == right && random.coinFlip())) ? -left : right;
+            if (dx) {
+                grid.swapTiles(x, y, x + dx, y - 1);
+                x += dx;
+                y -= 1;
+                return true;
+            }
+
+            // No drop-off in reach: step aside toward an open side while pushed, either from above by
+            // something that will fall into the gap, or along a ceiling by fluid behind. Columns and
+            // channels drain this way until the surface is level, and then everything stays put.
+            if (y + 1 >= grid.size.y) {
+                return false;
+            }
+            const MaterialInfo::Type above = materials[grid.get(x, y + 1).material].type;
+            const bool pressed = above == MaterialInfo::FLUID || above == MaterialInfo::GRAVITY;
+            if (!pressed && above != MaterialInfo::STATIC) {
+                return false;
+            }
+            auto classAt = [&](int side) {
+                return classify<true>(grid, x + side, y, classes);
+            };
+            const bool openLeft = classAt(-1) == MaterialRules::EMPTY;
+            const bool openRight = classAt(1) == MaterialRules::EMPTY;
+            int side;
+            if (pressed && (openLeft || openRight)) {
+                side = openLeft && (!openRight || random.coinFlip()) ? -1 : 1;
+            } else if (openLeft != openRight && classAt(openLeft ? 1 : -1) == MaterialRules::FLUID) {
+                side = openLeft ? -1 : 1;
+            } else {
+                return false;
+            }
+            grid.swapTiles(x, y, x + side, y);
+            x += side;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MaterialSimulator::processSandRow(Grid &grid, int y, const MaterialTable &materials, std::vector<uint64_t> &sand, std::vector<uint64_t> &open) {
+    static_assert(64 % Grid::CHUNK_SIZE == 0, "Words must cover whole chunk rows");
+    const int width = grid.size.x;
+    const int words = (width + 63) / 64;
+
+    // Sand in sleeping chunks can be left out: the tiles below it were already closed, and the sand
+    // moving here can only close more of them. Anything else there might be woken by those moves.
+    sand.assign(words, 0);
+    MaterialId kernel = MaterialTable::IDLE;
+    for (int cx = 0; cx < grid.chunkCount.x; ++cx) {
+        const int start = cx * Grid::CHUNK_SIZE;
+        const Pixel* row = grid.getRowSpan(cx, y) - start;
+        const bool awake = grid.isChunkAwake(cx, y / Grid::CHUNK_SIZE);
+        for (int x = start, end = std::min(start + Grid::CHUNK_SIZE, width); x < end; ++x) {
+            const MaterialId tileKernel = materials.getRowKernel(row[x].material);
+            if (tileKernel == MaterialTable::IDLE) {
+                continue;
+            }
+            if (tileKernel == MaterialTable::SCALAR || (kernel != MaterialTable::IDLE && tileKernel != kernel)) {
+                return false;
+            }
+            if (awake) {
+                kernel = tileKernel;
+                sand[x >> 6] |= uint64_t{1} << (x & 63);
+            }
+        }
+    }
+    // Nothing moves, or nothing can fall off the bottom row
+    if (kernel == MaterialTable::IDLE || y == 0) {
+        return true;
+    }
+
+    // Which tiles of the row below the sand could move into, for words next to any sand. Sand moves
+    // only replace open tiles with sand, so this shrinks as the row is processed but never grows.
+    const MaterialRules::CellClass* classes = materials.getClasses(kernel);
+    open.assign(words, 0);
+    for (int w = 0; w < words; ++w) {
+        if (!(sand[w] | (w > 0 ? sand[w - 1] : 0) | (w + 1 < words ? sand[w + 1] : 0))) {
+            continue;
+        }
+        uint64_t bits = 0;
+        for (int start = w * 64, wordEnd = std::min(width, start + 64); start < wordEnd; start += Grid::CHUNK_SIZE) {
+            const int first = grid.index(start, y - 1) - start;
+            const Pixel* below = &grid.data[first];
+            const uint8_t* updated = &grid.updated[first];
+            for (int x = start, end = std::min(start + Grid::CHUNK_SIZE, wordEnd); x < end; ++x) {
+                const MaterialId material = below[x].material;
+                const bool blocked = updated[x] && material != MaterialTable::AIR;
+                bits |= static_cast<uint64_t>(classes[material] == MaterialRules::EMPTY && !blocked) << (x & 63);
+            }
+        }
+        open[w] = bits;
+    }
+
+    auto isOpen = [&](int x) {
+        return x >= 0 && x < width && (open[x >> 6] >> (x & 63) & 1);
+    };
+
+    // Only sand with an open tile below, below left or below right can move. Each of them takes the
+    // first of those still open, in order, exactly like processTile would. The swaps are done here
+    // rather than with swapTiles so consecutive moves in the same chunk mark it dirty only once.
+    int fromChunk = -1, toChunk = -1;
+    for (int w = 0; w < words; ++w) {
+        // Bit x set if x - 1 or x + 1 is open
+        const uint64_t openLeft = open[w] << 1 | (w > 0 ? open[w - 1] >> 63 : 0);
+        const uint64_t openRight = open[w] >> 1 | (w + 1 < words ? open[w + 1] << 63 : 0);
+        uint64_t movers = sand[w] & (open[w] | openLeft | openRight);
+        while (movers) {
+            const int x = w * 64 + std::countr_zero(movers);
+            movers &= movers - 1;
+
+            int target;
+            if (isOpen(x)) {
+                target = x;
+            } else if (isOpen(x - 1)) {
+                target = x - 1;
+            } else if (isOpen(x + 1)) {
+                target = x + 1;
+            } else {
+                continue;
+            }
+            open[target >> 6] &= ~(uint64_t{1} << (target & 63));
+            grid.materialize(x, y);
+            grid.materialize(target, y - 1);
+            const int from = grid.index(x, y);
+            const int to = grid.index(target, y - 1);
+            std::swap(grid.data[from], grid.data[to]);
+            grid.updated[from] = true;
+            grid.updated[to] = true;
+            ++grid.moves;
+
+            if (x / Grid::CHUNK_SIZE != fromChunk) {
+                grid.markDirty(x, y);
+                fromChunk = x / Grid::CHUNK_SIZE;
+            }
+            if (target / Grid::CHUNK_SIZE != toChunk) {
+                grid.markDirty(target, y - 1);
+                toChunk = target / Grid::CHUNK_SIZE;
+            }
+        }
+    }
+    return true;
+}
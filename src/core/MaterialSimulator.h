@@ -0,0 +1,29 @@
+#ifndef MATERIALSIMULATOR_H
+#define MATERIALSIMULATOR_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Grid.h"
+#include "MaterialTable.h"
+#include "Random.h"
+
+class MaterialSimulator {
+    // Border tiles check their neighbors against the edges of the grid; the others skip that
+    template <bool Border>
+    static void processTile(Grid& grid, int x, int y, const MaterialTable& materials, Random& random);
+    // Applies the tile's action once, following it to where it moved. Returns whether it moved.
+    template <bool Border>
+    static bool step(Grid& grid, int& x, int& y, const MaterialTable& materials, const MaterialRules::Action* actions,
+                     uint8_t inspected, const MaterialRules::CellClass* classes, Random& random);
+    // Simulates a row where everything that moves falls like sand, 64 tiles at a time. Returns false
+    // without touching the grid if the row needs processTile.
+    static bool processSandRow(Grid& grid, int y, const MaterialTable& materials, std::vector<uint64_t>& sand, std::vector<uint64_t>& open);
+
+public:
+    static void process(Grid& grid, const MaterialTable& materials, Random& random);
+};
+
+
+
+#endif //MATERIALSIMULATOR_H
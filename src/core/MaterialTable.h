@@ -0,0 +1,292 @@
+#ifndef MATERIALTABLE_H
+#define MATERIALTABLE_H
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "MaterialRules.h"
+
+// The part of a material the simulation needs
+struct MaterialInfo {
+    enum Type : uint8_t {
+        EMPTY,
+        STATIC,
+        GRAVITY,
+        FLUID
+    } type = EMPTY;
+
+    // Denser materials sink through lighter fluids. Defaults to 0 for EMPTY, 1 for FLUID and 2 for
+    // the rest, so everything falls through air and solids through fluids.
+    std::optional<float> density;
+
+    [[nodiscard]] float getDensity() const {
+        return density.value_or(type == EMPTY ? 0.0f : type == FLUID ? 1.0f : 2.0f);
+    }
+
+    // How far a FLUID looks sideways for somewhere lower to flow to. At 1 it spreads a tile at a time
+    // in random directions instead, which never quite settles.
+    int dispersion = 1;
+
+    // Slow materials act only every updateInterval ticks; fast ones up to steps times per tick
+    int updateInterval = 1;
+    int steps = 1;
+
+    // Shade tiles by a hash of where they are instead of by an offset drawn for each tile, which
+    // suits materials that don't move
+    bool positionShaded = false;
+
+    // A material of the given type with every other setting at its default
+    static MaterialInfo ofType(const Type type) {
+        MaterialInfo info;
+        info.type = type;
+        return info;
+    }
+
+    [[nodiscard]] bool isFluid() const {
+        return type == FLUID;
+    }
+
+    [[nodiscard]] bool isSolid() const {
+        return type == STATIC || type == GRAVITY;
+    }
+
+    // How a tile of this material sees a neighbor of the other one
+    [[nodiscard]] MaterialRules::CellClass classify(const MaterialInfo& other) const {
+        switch (other.type) {
+            case EMPTY:
+                return MaterialRules::EMPTY;
+            case FLUID:
+                return getDensity() > other.getDensity() ? MaterialRules::EMPTY : MaterialRules::FLUID;
+            default:
+                return MaterialRules::SOLID;
+        }
+    }
+
+    // The built-in behavior of each type, used unless the config gives a material its own rules
+    [[nodiscard]] std::vector<MaterialRules::Rule> defaultRules() const {
+        using R = MaterialRules;
+        switch (type) {
+            case GRAVITY: {
+                // Fall, or slide off whatever is below, through air and lighter fluids
+                constexpr uint8_t into = R::bit(R::EMPTY);
+                return {R::move(R::BELOW, into), R::move(R::BELOW_LEFT, into), R::move(R::BELOW_RIGHT, into)};
+            }
+            case FLUID: {
+                // Fall, then spread sideways (randomly if both sides are open), displacing lighter fluids
+                constexpr uint8_t into = R::bit(R::EMPTY);
+                if (dispersion > 1) {
+                    return {R::move(R::BELOW, into), R::move(R::BELOW_LEFT, into), R::move(R::BELOW_RIGHT, into),
+                            R::flow(dispersion)};
+                }
+                return {R::move(R::BELOW, into), R::move(R::BELOW_LEFT, into), R::move(R::BELOW_RIGHT, into),
+                        R::moveEither(R::LEFT, R::RIGHT, into), R::move(R::LEFT, into), R::move(R::RIGHT, into)};
+            }
+            default:
+                return {};
+        }
+    }
+};
+
+class MaterialTable {
+    std::vector<MaterialInfo> info;
+    // How each material sees each other one as a neighbor, indexed [mover * size() + neighbor]
+    std::vector<MaterialRules::CellClass> classes;
+
+    // Compiled rules; actions holds NEIGHBORHOODS entries per material
+    std::vector<MaterialRules::Action> actions;
+    std::vector<uint8_t> inspected;
+    std::vector<uint8_t> active;
+    std::vector<MaterialId> rowKernels;
+    bool rowKernelsEnabled = true;
+
+    // Materials that behave exactly like default GRAVITY ones can be simulated by the row kernel
+    void updateRowKernels() {
+        static const MaterialRules::Program sand = MaterialRules::compile(MaterialInfo::ofType(MaterialInfo::GRAVITY).defaultRules());
+        auto fallsLikeSand = [&](MaterialId id) {
+            return info[id].updateInterval == 1 && info[id].steps == 1
+                && inspected[id] == sand.inspected
+                && std::equal(sand.actions.begin(), sand.actions.end(), actions.begin() + id * MaterialRules::NEIGHBORHOODS);
+        };
+
+        rowKernels.resize(info.size());
+        for (MaterialId id = 0; id < info.size(); ++id) {
+            if (!active[id]) {
+                rowKernels[id] = IDLE;
+            } else if (!rowKernelsEnabled || !fallsLikeSand(id)) {
+                rowKernels[id] = SCALAR;
+            } else {
+                // Materials see their neighbors the same way if their densities match
+                rowKernels[id] = id;
+                for (MaterialId other = 0; other < id; ++other) {
+                    if (rowKernels[other] == other && info[other].getDensity() == info[id].getDensity()) {
+                        rowKernels[id] = other;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+public:
+    // How the grid is simulated; see MaterialSimulator and MargolusSimulator
+    enum Mode : uint8_t {
+        SEQUENTIAL,
+        MARGOLUS
+    };
+
+private:
+    Mode mode = SEQUENTIAL;
+
+public:
+    static constexpr MaterialId AIR = 0;
+    // Row kernel markers for materials that never do anything, and for ones that need processTile
+    static constexpr MaterialId IDLE = 0xFFFF;
+    static constexpr MaterialId SCALAR = 0xFFFE;
+
+    MaterialId add(const MaterialInfo& material) {
+        auto id = static_cast<MaterialId>(info.size());
+        info.push_back(material);
+        classes.resize(info.size() * info.size());
+        for (size_t mover = 0; mover < info.size(); ++mover) {
+            for (size_t neighbor = 0; neighbor < info.size(); ++neighbor) {
+                classes[mover * info.size() + neighbor] = info[mover].classify(info[neighbor]);
+            }
+        }
+        actions.resize(info.size() * MaterialRules::NEIGHBORHOODS);
+        inspected.push_back(0);
+        active.push_back(false);
+        setRules(id, material.defaultRules());
+        return id;
+    }
+
+    void setRules(MaterialId id, const std::vector<MaterialRules::Rule>& rules) {
+        MaterialRules::Program program = MaterialRules::compile(rules);
+        std::copy(program.actions.begin(), program.actions.end(), actions.begin() + id * MaterialRules::NEIGHBORHOODS);
+        inspected[id] = program.inspected;
+        active[id] = program.active;
+        updateRowKernels();
+    }
+
+    [[nodiscard]] const MaterialInfo& operator[](const MaterialId id) const {
+        return info[id];
+    }
+
+    // The classes of all materials as seen by mover, indexed by the neighbor's MaterialId
+    [[nodiscard]] const MaterialRules::CellClass* getClasses(const MaterialId mover) const {
+        return &classes[mover * info.size()];
+    }
+
+    // The compiled actions of a material indexed by neighborhood, or null if it never does anything
+    [[nodiscard]] const MaterialRules::Action* getActions(const MaterialId id) const {
+        return active[id] ? &actions[id * MaterialRules::NEIGHBORHOODS] : nullptr;
+    }
+
+    [[nodiscard]] uint8_t getInspectedDirections(const MaterialId id) const {
+        return inspected[id];
+    }
+
+    // IDLE, SCALAR, or the first material that falls exactly like this one
+    [[nodiscard]] MaterialId getRowKernel(const MaterialId id) const {
+        return rowKernels[id];
+    }
+
+    // With row kernels off every moving material goes through processTile, which the row kernel
+    // has to match exactly
+    void setRowKernelsEnabled(const bool enabled) {
+        rowKernelsEnabled = enabled;
+        updateRowKernels();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return info.size();
+    }
+
+    // The built table, compiled rules and neighbor classes included, as bytes for a cache to store.
+    // Only the same build can read them back, so the layout of the entries is part of the data.
+    [[nodiscard]] std::vector<uint8_t> serialize() const {
+        std::vector<uint8_t> out;
+        auto append = [&](const void* data, size_t bytes) {
+            const auto* begin = static_cast<const uint8_t*>(data);
+            out.insert(out.end(), begin, begin + bytes);
+        };
+        auto appendVector = [&](const auto& v) {
+            static_assert(std::is_trivially_copyable_v<std::decay_t<decltype(v[0])>>);
+            const auto count = static_cast<uint32_t>(v.size());
+            append(&count, sizeof(count));
+            append(v.data(), count * sizeof(v[0]));
+        };
+
+        const uint32_t layout[] = {sizeof(MaterialInfo), sizeof(MaterialRules::Action), MaterialRules::NEIGHBORHOODS};
+        append(layout, sizeof(layout));
+        appendVector(info);
+        appendVector(classes);
+        appendVector(actions);
+        appendVector(inspected);
+        appendVector(active);
+        appendVector(rowKernels);
+        const uint8_t flags[] = {rowKernelsEnabled, mode};
+        append(flags, sizeof(flags));
+        return out;
+    }
+
+    // Replaces the table with one written by serialize(). Returns false, leaving the table as it
+    // was, if the bytes don't hold a table from this build.
+    bool deserialize(const uint8_t* data, const size_t size) {
+        const uint8_t* const end = data + size;
+        auto read = [&](void* target, size_t bytes) {
+            if (static_cast<size_t>(end - data) < bytes) {
+                return false;
+            }
+            std::memcpy(target, data, bytes);
+            data += bytes;
+            return true;
+        };
+        auto readVector = [&](auto& v) {
+            uint32_t count;
+            if (!read(&count, sizeof(count)) || static_cast<size_t>(end - data) / sizeof(v[0]) < count) {
+                return false;
+            }
+            v.resize(count);
+            return read(v.data(), count * sizeof(v[0]));
+        };
+
+        const uint32_t expected[] = {sizeof(MaterialInfo), sizeof(MaterialRules::Action), MaterialRules::NEIGHBORHOODS};
+        uint32_t layout[3];
+        if (!read(layout, sizeof(layout)) || std::memcmp(layout, expected, sizeof(layout)) != 0) {
+            return false;
+        }
+
+        MaterialTable table;
+        uint8_t flags[2];
+        if (!readVector(table.info) || !readVector(table.classes) || !readVector(table.actions)
+                || !readVector(table.inspected) || !readVector(table.active) || !readVector(table.rowKernels)
+                || !read(flags, sizeof(flags)) || data != end) {
+            return false;
+        }
+        const size_t count = table.info.size();
+        if (table.classes.size() != count * count || table.actions.size() != count * MaterialRules::NEIGHBORHOODS
+                || table.inspected.size() != count || table.active.size() != count || table.rowKernels.size() != count) {
+            return false;
+        }
+        table.rowKernelsEnabled = flags[0];
+        table.mode = static_cast<Mode>(flags[1]);
+        *this = std::move(table);
+        return true;
+    }
+
+    void setMode(Mode mode) {
+        this->mode = mode;
+    }
+
+    [[nodiscard]] Mode getMode() const {
+        return mode;
+    }
+};
+
+
+#endif //MATERIALTABLE_H
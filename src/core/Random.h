@@ -0,0 +1,68 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Small, fast PCG32 generator (https://www.pcg-random.org). Every simulation owns one, so a run
+// is reproducible from its seed; parallel workers each take their own stream with fork().
+class Random {
+    uint64_t state = 0;
+    uint64_t increment = 1;
+
+public:
+    explicit Random(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL) {
+        seedWith(seed, stream);
+    }
+
+    void seedWith(uint64_t seed, uint64_t stream = 0xda3e39cb94b95bdbULL) {
+        state = 0;
+        increment = (stream << 1u) | 1u;
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        auto xorShifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        auto rot = static_cast<uint32_t>(old >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((-rot) & 31));
+    }
+
+    // Inclusive on both ends, like UtilityFunctions::randi_range
+    int range(int from, int to) {
+        return from + static_cast<int>(next() % static_cast<uint32_t>(to - from + 1));
+    }
+
+    bool coinFlip() {
+        return next() & 1u;
+    }
+
+    // In [0, 1)
+    double uniform() {
+        return next() * (1.0 / 4294967296.0);
+    }
+
+    // The full state, so a run can be saved and picked up exactly where its sequence was
+    [[nodiscard]] uint64_t getState() const {
+        return state;
+    }
+
+    [[nodiscard]] uint64_t getIncrement() const {
+        return increment;
+    }
+
+    void restore(const uint64_t savedState, const uint64_t savedIncrement) {
+        state = savedState;
+        increment = savedIncrement | 1u;
+    }
+
+    // An independent generator derived from this one's current state
+    [[nodiscard]] Random fork(uint64_t stream) const {
+        return Random{state, increment ^ (stream << 1u)};
+    }
+};
+
+
+#endif //RANDOM_H
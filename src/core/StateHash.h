@@ -0,0 +1,42 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <cstdint>
+
+#include "Grid.h"
+
+// Order-dependent 64-bit hash used to check that two runs stay bit-identical (e.g. before and
+// after an optimization). Not meant to be cryptographically strong.
+class StateHash {
+    uint64_t value;
+
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+public:
+    explicit StateHash(uint64_t seed = 0) : value(seed) {}
+
+    void add(uint64_t x) {
+        value = mix(value ^ x);
+    }
+
+    void add(const Grid& grid) {
+        add(static_cast<uint64_t>(grid.size.x) << 32 | static_cast<uint32_t>(grid.size.y));
+        // Row by row, so the hash doesn't depend on how the grid is stored
+        for (int y = 0; y < grid.size.y; ++y) {
+            for (int x = 0; x < grid.size.x; ++x) {
+                const Pixel& p = grid[x, y];
+                add(p.material | static_cast<uint64_t>(static_cast<uint8_t>(p.colorOffset)) << 16);
+            }
+        }
+    }
+
+    [[nodiscard]] uint64_t get() const { return value; }
+};
+
+
+#endif //STATEHASH_H
@@ -0,0 +1,13 @@
+#ifndef VEC2I_H
+#define VEC2I_H
+
+// Minimal integer vector so the core doesn't need godot::Vector2i
+struct Vec2i {
+    int x = 0;
+    int y = 0;
+
+    bool operator==(const Vec2i&) const = default;
+};
+
+
+#endif //VEC2I_H
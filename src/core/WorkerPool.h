@@ -0,0 +1,99 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that stay parked between jobs, so work split across threads many times per tick doesn't
+// pay for starting and joining threads each time. Workers are started on first use.
+class WorkerPool {
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::vector<std::thread> workers;
+
+    // The current job, shared by every worker; guarded by mutex
+    const std::function<void(int)>* job = nullptr;
+    int jobCount = 0;
+    int pending = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void work(const int index, uint64_t seen) {
+        std::unique_lock lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            if (index >= jobCount - 1) {
+                continue;
+            }
+
+            lock.unlock();
+            (*job)(index);
+            lock.lock();
+            if (--pending == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Calls f(0) to f(count - 1) in parallel and returns once all are done. The last one runs on
+    // the calling thread. Only one thread may call run at a time.
+    void run(const int count, const std::function<void(int)>& f) {
+        if (count <= 1) {
+            if (count == 1) {
+                f(0);
+            }
+            return;
+        }
+
+        // New workers wait for the generation after the current one, which is this job's
+        while (static_cast<int>(workers.size()) < count - 1) {
+            workers.emplace_back(&WorkerPool::work, this, static_cast<int>(workers.size()), generation);
+        }
+        {
+            std::lock_guard lock(mutex);
+            job = &f;
+            jobCount = count;
+            pending = count - 1;
+            ++generation;
+        }
+        wake.notify_all();
+
+        f(count - 1);
+
+        std::unique_lock lock(mutex);
+        done.wait(lock, [&] { return pending == 0; });
+        job = nullptr;
+    }
+
+    [[nodiscard]] int getWorkerCount() const {
+        return static_cast<int>(workers.size());
+    }
+};
+
+
+#endif //WORKERPOOL_H
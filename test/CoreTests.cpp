@@ -0,0 +1,421 @@
+// Determinism tests for the Godot-independent simulation core. Built and run with `scons test`.
+//
+// Each check runs the same scenario two ways that must end in bit-identical states, and prints a
+// line to stderr. The final state hash of every scenario goes to stdout, so `scons test` can also
+// compare the flat and tiled grid layouts (which need separate builds):
+//   ./build/test/flat/fishbytes_tests > flat.txt
+// Exits with 1 if any check failed.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MargolusSimulator.h"
+#include "MaterialSimulator.h"
+#include "StateHash.h"
+
+namespace {
+    int failures = 0;
+
+    void check(const std::string& name, uint64_t expected, uint64_t actual) {
+        if (expected == actual) {
+            std::fprintf(stderr, "ok    %s\n", name.c_str());
+        } else {
+            std::fprintf(stderr, "FAIL  %s: %016" PRIx64 " != %016" PRIx64 "\n", name.c_str(), expected, actual);
+            ++failures;
+        }
+    }
+
+    void printHash(const std::string& name, uint64_t hash) {
+        std::printf("%s %016" PRIx64 "\n", name.c_str(), hash);
+    }
+
+    struct TestMaterials {
+        MaterialTable table;
+        MaterialId sand, gravel, water, oil, wood, slowSand, offbeatSand, levelingWater, fastSand, sapling;
+
+        TestMaterials() {
+            table.add(MaterialInfo::ofType(MaterialInfo::EMPTY));
+            sand = table.add(MaterialInfo::ofType(MaterialInfo::GRAVITY));
+            // Sinks through sand, so it gets a row kernel of its own
+            MaterialInfo heavy = MaterialInfo::ofType(MaterialInfo::GRAVITY);
+            heavy.density = 3.0f;
+            gravel = table.add(heavy);
+            water = table.add(MaterialInfo::ofType(MaterialInfo::FLUID));
+            MaterialInfo light = MaterialInfo::ofType(MaterialInfo::FLUID);
+            light.density = 0.8f;
+            oil = table.add(light);
+            wood = table.add(MaterialInfo::ofType(MaterialInfo::STATIC));
+            // Falls like sand but not every tick, so it always needs processTile
+            MaterialInfo slow = MaterialInfo::ofType(MaterialInfo::GRAVITY);
+            slow.updateInterval = 2;
+            slowSand = table.add(slow);
+            // Takes its turns on the ticks slowSand doesn't
+            offbeatSand = table.add(slow);
+            // Flows to drop-offs up to 8 tiles away instead of spreading a tile at a time
+            MaterialInfo leveling = MaterialInfo::ofType(MaterialInfo::FLUID);
+            leveling.dispersion = 8;
+            levelingWater = table.add(leveling);
+            MaterialInfo fast = MaterialInfo::ofType(MaterialInfo::GRAVITY);
+            fast.steps = 3;
+            fastSand = table.add(fast);
+            // Falls like sand and turns into wood once it lands on something
+            sapling = table.add(MaterialInfo::ofType(MaterialInfo::GRAVITY));
+            std::vector<MaterialRules::Rule> rules = table[sapling].defaultRules();
+            MaterialRules::Rule root;
+            root.when[MaterialRules::BELOW] = MaterialRules::bit(MaterialRules::SOLID);
+            root.action.kind = MaterialRules::Action::BECOME;
+            root.action.material = wood;
+            rules.push_back(root);
+            table.setRules(sapling, rules);
+        }
+    };
+
+    // Every material mixed together, which keeps most rows on processTile
+    std::vector<MaterialId> allMaterials(const TestMaterials& materials) {
+        return {materials.sand, materials.gravel, materials.water, materials.oil, materials.wood, materials.slowSand};
+    }
+
+    // Fills about half the grid with the given materials. Sizes that aren't a multiple of the chunk
+    // size cover partial chunks too.
+    Grid makeGrid(const std::vector<MaterialId>& mix, int width, int height, Random& random) {
+        Grid grid({width, height});
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                // Mostly air, so things keep moving for a while
+                const int roll = random.range(0, 2 * static_cast<int>(mix.size()) - 1);
+                if (roll < static_cast<int>(mix.size())) {
+                    grid[x, y] = Pixel{mix[roll], random};
+                }
+            }
+        }
+        return grid;
+    }
+
+    using Simulate = std::function<void(Grid&, Random&)>;
+
+    // Runs the ticks and returns the state hash rolled after each, as GameState does
+    uint64_t simulate(Grid& grid, Random& random, int ticks, const Simulate& tick, uint64_t hash = 0) {
+        for (int i = 0; i < ticks; ++i) {
+            tick(grid, random);
+            StateHash rolling(hash);
+            rolling.add(grid);
+            hash = rolling.get();
+        }
+        return hash;
+    }
+
+    void testRowKernel(const TestMaterials& materials) {
+        TestMaterials scalar;
+        scalar.table.setRowKernelsEnabled(false);
+
+        // Rows of only sand and wood run entirely on the row kernel; mixed ones switch between both
+        const std::pair<std::string, std::vector<MaterialId>> mixes[] = {
+            {"sand", {materials.sand, materials.wood}},
+            {"mixed", allMaterials(materials)},
+        };
+        for (const auto& [name, mix] : mixes) {
+            uint64_t hashes[2];
+            const MaterialTable* tables[2] = {&materials.table, &scalar.table};
+            for (int i = 0; i < 2; ++i) {
+                Random random{1};
+                Grid grid = makeGrid(mix, 200, 150, random);
+                hashes[i] = simulate(grid, random, 200, [&](Grid& g, Random& r) {
+                    MaterialSimulator::process(g, *tables[i], r);
+                });
+            }
+            check("row kernel matches processTile (" + name + ")", hashes[1], hashes[0]);
+            printHash("sequential/" + name, hashes[0]);
+        }
+    }
+
+    // ConfigCache stores the compiled table as bytes; a table read back must simulate the same
+    void testSerializedTable(const TestMaterials& materials) {
+        const std::vector<uint8_t> bytes = materials.table.serialize();
+        MaterialTable restored;
+        const bool read = restored.deserialize(bytes.data(), bytes.size());
+        check("serialized table reads back", 1, read);
+
+        uint64_t hashes[2];
+        const MaterialTable* tables[2] = {&materials.table, &restored};
+        for (int i = 0; i < 2; ++i) {
+            Random random{4};
+            Grid grid = makeGrid(allMaterials(materials), 150, 100, random);
+            hashes[i] = simulate(grid, random, 100, [&](Grid& g, Random& r) {
+                MaterialSimulator::process(g, *tables[i], r);
+            });
+        }
+        check("serialized table simulates the same", hashes[0], hashes[1]);
+
+        MaterialTable truncated;
+        check("truncated table is rejected", 0, truncated.deserialize(bytes.data(), bytes.size() - 1));
+    }
+
+    // Slow materials keep their chunk awake only while they may still have a turn to take, so a pile
+    // of them that settled goes to sleep (even with some of them waiting for their turn on every
+    // tick), and ends up just as it would if nothing ever slept
+    void testSlowMaterialsSleep(const TestMaterials& materials) {
+        uint64_t hashes[2];
+        int activeChunks[2];
+        for (int i = 0; i < 2; ++i) {
+            const bool sleeping = i == 0;
+            Random random{5};
+            Grid grid = makeGrid({materials.slowSand, materials.offbeatSand}, 100, 80, random);
+            hashes[i] = simulate(grid, random, 600, [&](Grid& g, Random& r) {
+                if (!sleeping) {
+                    g.wakeAll();
+                }
+                MaterialSimulator::process(g, materials.table, r);
+            });
+            activeChunks[i] = grid.activeChunkCount;
+        }
+        check("settled slow materials sleep", 0, activeChunks[0]);
+        check("sleeping slow materials match a full scan", hashes[1], hashes[0]);
+        printHash("slow-settled", hashes[0]);
+    }
+
+    // Chunks sleep only where nothing can happen, so forcing every chunk awake on every tick must
+    // give the same result, for each kind of action
+    void testSleepingMatchesFullScan(const TestMaterials& materials) {
+        const std::pair<std::string, std::vector<MaterialId>> mixes[] = {
+            {"mixed", allMaterials(materials)},
+            {"flow", {materials.levelingWater, materials.oil, materials.sand, materials.wood}},
+            {"become", {materials.sapling, materials.water, materials.wood}},
+            {"steps", {materials.fastSand, materials.water, materials.wood}},
+        };
+        for (const auto& [name, mix] : mixes) {
+            uint64_t hashes[2];
+            for (int i = 0; i < 2; ++i) {
+                const bool sleeping = i == 0;
+                Random random{6};
+                Grid grid = makeGrid(mix, 150, 100, random);
+                hashes[i] = simulate(grid, random, 300, [&](Grid& g, Random& r) {
+                    if (!sleeping) {
+                        g.wakeAll();
+                    }
+                    MaterialSimulator::process(g, materials.table, r);
+                });
+            }
+            check("sleeping matches a full scan (" + name + ")", hashes[1], hashes[0]);
+            printHash("full-scan/" + name, hashes[0]);
+        }
+    }
+
+    int countTiles(const Grid& grid, MaterialId material) {
+        int count = 0;
+        for (int y = 0; y < grid.size.y; ++y) {
+            for (int x = 0; x < grid.size.x; ++x) {
+                count += grid.get(x, y).material == material;
+            }
+        }
+        return count;
+    }
+
+    // A tall column of fluid with a dispersion spreads out along the floor until no column stands more
+    // than a tile above its neighbors, and then settles. Fluid walled in above the floor gets out
+    // through the bottom row, where it has no drop-off in reach, by stepping aside from under the
+    // fluid above it.
+    void testFlowLevels(const TestMaterials& materials) {
+        Random random{7};
+        Grid grid({64, 40});
+        for (int y = 0; y < 20; ++y) {
+            for (int x = 28; x < 36; ++x) {
+                grid.set(x, y, Pixel{materials.levelingWater, random});
+            }
+        }
+        const uint64_t hash = simulate(grid, random, 400, [&](Grid& g, Random& r) {
+            MaterialSimulator::process(g, materials.table, r);
+        });
+
+        int step = 0;
+        for (int x = 0, previous = 0; x < grid.size.x; ++x) {
+            int height = 0;
+            while (height < grid.size.y && grid.get(x, height).material == materials.levelingWater) {
+                ++height;
+            }
+            if (x > 0) {
+                step = std::max(step, std::abs(height - previous));
+            }
+            previous = height;
+        }
+        check("flowing water levels out", 1, step);
+        check("level water settles", 0, grid.activeChunkCount);
+        check("flowing water is all there", 8 * 20, countTiles(grid, materials.levelingWater));
+        printHash("flow-level", hash);
+
+        Grid walled({32, 32});
+        for (int y = 0; y < 6; ++y) {
+            walled.set(10, y, Pixel{materials.levelingWater, random});
+            if (y > 0) {
+                walled.set(9, y, Pixel{materials.wood, random});
+                walled.set(11, y, Pixel{materials.wood, random});
+            }
+        }
+        simulate(walled, random, 100, [&](Grid& g, Random& r) {
+            MaterialSimulator::process(g, materials.table, r);
+        });
+        int raised = 0;
+        for (int y = 2; y < walled.size.y; ++y) {
+            raised += walled.get(10, y).material == materials.levelingWater;
+        }
+        check("walled-in water drains along the floor", 0, raised);
+        check("and settles", 0, walled.activeChunkCount);
+    }
+
+    // Fast materials act again from wherever their last step took them
+    void testSteps(const TestMaterials& materials) {
+        Random random{8};
+        Grid grid({32, 32});
+        grid.set(10, 30, Pixel{materials.fastSand, random});
+        MaterialSimulator::process(grid, materials.table, random);
+        check("fast sand falls three tiles a tick", materials.fastSand, grid.get(10, 27).material);
+        MaterialSimulator::process(grid, materials.table, random);
+        check("and again the next tick", materials.fastSand, grid.get(10, 24).material);
+    }
+
+    // BECOME rules apply once their neighborhood matches, and not before
+    void testBecome(const TestMaterials& materials) {
+        Random random{9};
+        Grid grid = makeGrid({materials.sapling, materials.wood}, 96, 64, random);
+        const int saplings = countTiles(grid, materials.sapling);
+        const int wood = countTiles(grid, materials.wood);
+        simulate(grid, random, 200, [&](Grid& g, Random& r) {
+            MaterialSimulator::process(g, materials.table, r);
+        });
+        // Only saplings that fell all the way to the bottom row have nothing below to take root on
+        int bottom = 0;
+        for (int x = 0; x < grid.size.x; ++x) {
+            bottom += grid.get(x, 0).material == materials.sapling;
+        }
+        check("saplings take root where they land", bottom, countTiles(grid, materials.sapling));
+        check("and turn into wood", wood + saplings - bottom, countTiles(grid, materials.wood));
+    }
+
+    void testMargolusThreads(const TestMaterials& materials) {
+        uint64_t single = 0;
+        for (int threads : {1, 2, 3, 4}) {
+            Random random{2};
+            Grid grid = makeGrid(allMaterials(materials), 256, 256, random);
+            MargolusSimulator simulator;
+            const uint64_t hash = simulate(grid, random, 100, [&](Grid& g, Random&) {
+                simulator.process(g, materials.table, threads);
+            });
+            if (threads == 1) {
+                single = hash;
+                printHash("margolus", hash);
+            } else {
+                check("margolus with " + std::to_string(threads) + " threads matches 1", single, hash);
+            }
+        }
+    }
+
+    // A stroke painted before a given frame, as journals record them
+    struct Paint {
+        int frame;
+        MaterialId material;
+        int x, y, radius;
+    };
+
+    void paint(Grid& grid, Random& random, const Paint& stroke) {
+        for (int y = stroke.y - stroke.radius; y <= stroke.y + stroke.radius; ++y) {
+            for (int x = stroke.x - stroke.radius; x <= stroke.x + stroke.radius; ++x) {
+                if (x >= 0 && x < grid.size.x && y >= 0 && y < grid.size.y) {
+                    grid.set(x, y, Pixel{stroke.material, random});
+                }
+            }
+        }
+    }
+
+    // Runs frames, painting the strokes that are due, and returns the hash after each frame
+    std::vector<uint64_t> play(Grid& grid, Random& random, const std::vector<Paint>& strokes, int frames, const Simulate& tick, uint64_t hash) {
+        std::vector<uint64_t> hashes;
+        for (int frame = 0; frame < frames; ++frame) {
+            for (const Paint& stroke : strokes) {
+                if (stroke.frame == frame) {
+                    paint(grid, random, stroke);
+                }
+            }
+            hash = simulate(grid, random, 1, tick, hash);
+            hashes.push_back(hash);
+        }
+        return hashes;
+    }
+
+    // Records a session the way InputJournal does (the tiles, the tick and the hash so far, the random
+    // state, then the strokes) and replays it into a grid rebuilt from those tiles, which like
+    // GameState::loadSnapshot doesn't know which chunks were asleep
+    void testReplay(const TestMaterials& materials, const std::string& name, const Simulate& tick) {
+        Random random{3};
+        Grid grid = makeGrid(allMaterials(materials), 120, 90, random);
+        uint64_t hash = simulate(grid, random, 50, tick);
+
+        const std::vector<Paint> strokes = {
+            {0, materials.sand, 30, 80, 4},
+            {5, materials.water, 90, 70, 6},
+            {5, materials.wood, 60, 40, 2},
+            {12, MaterialTable::AIR, 20, 10, 5},
+            {20, materials.oil, 100, 85, 3},
+        };
+        constexpr int FRAMES = 60;
+
+        const Grid baseline = grid;
+        const uint64_t baselineHash = hash;
+        const uint64_t randomState = random.getState();
+        const uint64_t randomIncrement = random.getIncrement();
+        const std::vector<uint64_t> recorded = play(grid, random, strokes, FRAMES, tick, hash);
+
+        Grid replayed(baseline.size);
+        for (int y = 0; y < baseline.size.y; ++y) {
+            for (int x = 0; x < baseline.size.x; ++x) {
+                replayed.set(x, y, baseline.get(x, y));
+            }
+        }
+        replayed.tick = baseline.tick;
+        Random replayRandom;
+        replayRandom.restore(randomState, randomIncrement);
+        const std::vector<uint64_t> replay = play(replayed, replayRandom, strokes, FRAMES, tick, baselineHash);
+
+        int divergedAt = -1;
+        for (int frame = 0; frame < FRAMES && divergedAt == -1; ++frame) {
+            if (recorded[frame] != replay[frame]) {
+                divergedAt = frame;
+            }
+        }
+        if (divergedAt != -1) {
+            std::fprintf(stderr, "      %s replay diverged after frame %d\n", name.c_str(), divergedAt);
+        }
+        check(name + " replay matches the recording", recorded.back(), replay.back());
+        printHash(name + "-replay", recorded.back());
+    }
+}
+
+int main() {
+    const TestMaterials materials;
+
+    testRowKernel(materials);
+    testSerializedTable(materials);
+    testSlowMaterialsSleep(materials);
+    testSleepingMatchesFullScan(materials);
+    testFlowLevels(materials);
+    testSteps(materials);
+    testBecome(materials);
+    testMargolusThreads(materials);
+    testReplay(materials, "sequential", [&](Grid& grid, Random& random) {
+        MaterialSimulator::process(grid, materials.table, random);
+    });
+    MargolusSimulator margolus;
+    testReplay(materials, "margolus", [&](Grid& grid, Random&) {
+        margolus.process(grid, materials.table, 2);
+    });
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}